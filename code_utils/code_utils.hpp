@@ -4,19 +4,113 @@
 #include <ctime>
 #include <type_traits>
 #include <concepts>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <map>
+#include <unordered_map>
+#include <fstream>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <bit>
+#include <vector>
+#include <string_view>
+#include <new>
+#include <charconv>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <stop_token>
+#include <span>
+#include <filesystem>
+#include <limits>
+#include <array>
+#include <cmath>
+#include <cassert>
+#include <iterator>
+#include <unordered_set>
+#include <source_location>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+#if defined(__linux__)
+#include <csignal>
+#include <sys/time.h>
+#include <execinfo.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <sys/mman.h>
+#include <sys/utsname.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace cutils {
 
-#if LOGGING_ON
-#define LOGN(x) std::cout<< #x <<": "; cutils::print(x)
+/**
+ * LOG(...) prints like print(...) and LOGN(x) prints "x: " and x. What goes in front of the
+ * line is chosen at runtime with set_log_prefix, the location of every call site is formatted
+ * once and kept in a static.
+ */
+#define CUTILS_LOG_SITE static cutils::detail::LogSite const cutils_log_location(std::source_location::current())
+#if LOGGING_ON && LOG_JSON
+#define LOGN(x) do { CUTILS_LOG_SITE; cutils::detail::write_json_named_record(&cutils_log_location, #x, x); } while (false)
+#elif LOGGING_ON
+#define LOGN(x) do { CUTILS_LOG_SITE; cutils::detail::log_named(cutils_log_location, #x, x); } while (false)
+#else
+#define LOGN(x) do {} while (false)
+#endif
+
+#if LOGGING_ON && LOG_JSON
+#define LOG(...) do { CUTILS_LOG_SITE; cutils::detail::write_json_record(&cutils_log_location __VA_OPT__(,) __VA_ARGS__); } while (false)
+#elif LOGGING_ON
+#define LOG(...) do { CUTILS_LOG_SITE; cutils::detail::log_line(cutils_log_location __VA_OPT__(,) __VA_ARGS__); } while (false)
 #else
-#define LOGN(x)
+#define LOG(...) do {} while (false)
 #endif
 
+/**
+ * LOG that only runs on some calls of the same call site, e.g. in an error path of a hot loop.
+ * Every macro use has its own static state shared by all threads. When a line is logged after
+ * others were dropped, a line with the number of dropped lines comes first. For LOG_EVERY_T and
+ * LOG_RATELIMITED that number can miss up to 1023 lines of every other thread.
+ *   LOG_EVERY_N(n, ...)                 the 1st, n+1st, 2n+1st ... call
+ *   LOG_FIRST_N(n, ...)                 the first n calls
+ *   LOG_EVERY_T(period, ...)            at most once per std::chrono duration
+ *   LOG_RATELIMITED(rate, burst, ...)   token bucket, rate lines per second and bursts of up to burst lines
+ */
 #if LOGGING_ON
-#define LOG(...) cutils::print(__VA_ARGS__)
+#define CUTILS_LOG_SAMPLED(site_type, check_args, ...) \
+  do { \
+    static site_type cutils_log_site; \
+    [[maybe_unused]] static thread_local std::uint64_t cutils_log_pending = 0; \
+    std::uint64_t cutils_log_suppressed = 0; \
+    if (cutils_log_site.should_log check_args) { \
+      if (cutils_log_suppressed != 0) { LOG("suppressed", cutils_log_suppressed, "lines"); } \
+      LOG(__VA_ARGS__); \
+    } \
+  } while (false)
+#define LOG_EVERY_N(n, ...) CUTILS_LOG_SAMPLED(cutils::detail::LogEveryN, ((n), cutils_log_suppressed), __VA_ARGS__)
+#define LOG_FIRST_N(n, ...) CUTILS_LOG_SAMPLED(cutils::detail::LogFirstN, ((n), cutils_log_suppressed), __VA_ARGS__)
+#define LOG_EVERY_T(period, ...) \
+  CUTILS_LOG_SAMPLED(cutils::detail::LogEveryT, ((period), cutils_log_pending, cutils_log_suppressed), __VA_ARGS__)
+#define LOG_RATELIMITED(rate, burst, ...) \
+  CUTILS_LOG_SAMPLED(cutils::detail::LogRateLimit, ((rate), (burst), cutils_log_pending, cutils_log_suppressed), __VA_ARGS__)
 #else
-#define LOG(...);
+#define LOG_EVERY_N(n, ...) do {} while (false)
+#define LOG_FIRST_N(n, ...) do {} while (false)
+#define LOG_EVERY_T(period, ...) do {} while (false)
+#define LOG_RATELIMITED(rate, burst, ...) do {} while (false)
 #endif
 
 #if PRINTING_ON
@@ -29,11 +123,11 @@ namespace cutils {
 template<typename C> concept Beginable= requires(C c) {std::begin(c);};
 template<typename C> concept Endable= requires(C c) {std::end(c);};
 template<typename C> concept NeqableBeginAndEnd = requires(C c) {{std::begin(c) != std::end(c)} -> std::same_as<bool>;};
-template<typename C> concept BeginIncrementable = requires(C c) {std::begin(c)++;};
+template<typename C> concept BeginIncrementable = requires(C c, decltype(std::begin(std::declval<C&>()))& it) {it++;};
 template<typename C> concept BeginDerefable = requires(C c) {*std::begin(c);};
 template<typename C> concept BeginDerefToVoid = requires(C c) {{*std::begin(c)} -> std::same_as<void>;};
 template<typename C> concept BeginAndEndCopyConstructibleAndDestructible = requires(C c) {
-  std::destructible<decltype(std::begin(c))> &&
+  requires std::destructible<decltype(std::begin(c))> &&
       std::destructible<decltype(std::end(c))> &&
       std::copy_constructible<decltype(std::begin(c))> &&
       std::copy_constructible<decltype(std::end(c))>;
@@ -49,11 +143,123 @@ Beginable<C> &&
     !BeginDerefToVoid<C> &&
     BeginAndEndCopyConstructibleAndDestructible<C>;
 
+/** a Container that knows its size in O(1), e.g. std::list. */
+template<typename C> concept SizedContainer =
+Container<C> &&
+    requires(C const& c) {{std::size(c)} -> std::convertible_to<std::size_t>;};
+
+/** a SizedContainer with random access iterators, e.g. std::deque. */
+template<typename C> concept RandomAccessContainer =
+SizedContainer<C> &&
+    std::random_access_iterator<decltype(std::begin(std::declval<C const&>()))>;
+
+/** a RandomAccessContainer whose elements are contiguous in memory, e.g. std::vector or std::array. */
+template<typename C> concept ContiguousContainer =
+RandomAccessContainer<C> &&
+    std::contiguous_iterator<decltype(std::begin(std::declval<C const&>()))> &&
+    requires(C const& c) {{std::data(c)} -> std::same_as<std::add_pointer_t<std::remove_reference_t<decltype(*std::begin(c))>>>;};
+
+namespace detail {
+/** converts to anything, to probe how many initializers an aggregate takes. Never called. */
+struct any_field {
+  template<typename T> operator T() const;
+};
+
+template<typename T, typename... Fields>
+consteval std::size_t aggregate_arity()
+{
+  if constexpr (requires { T{std::declval<Fields>()..., any_field{}}; } and sizeof...(Fields) < 64) {
+    return aggregate_arity<T, Fields..., any_field>();
+  }
+  else { return sizeof...(Fields); }
+}
+
+/**
+ * aggregate_arity with every initializer in its own braces, which rules out brace elision.
+ * The two differ when a member is an array: struct { int a[3]; double b; } takes four
+ * plain initializers but only two braced ones.
+ */
+template<typename T, typename... Fields>
+consteval std::size_t braced_aggregate_arity()
+{
+  if constexpr (requires { T{{std::declval<Fields>()}..., {any_field{}}}; } and sizeof...(Fields) < 64) {
+    return braced_aggregate_arity<T, Fields..., any_field>();
+  }
+  else { return sizeof...(Fields); }
+}
+}
+
+/**
+ * a plain aggregate with at most 16 fields and no array members, e.g. struct { int a; double b; }.
+ * Its fields can be visited with for_each_field without writing any code for the type.
+ */
+template<typename T> concept Reflectable =
+std::is_aggregate_v<T> &&
+    !std::is_array_v<T> &&
+    detail::aggregate_arity<T>() <= 16 &&
+    detail::aggregate_arity<T>() == detail::braced_aggregate_arity<T>();
+
+/**
+ * calls visit(f0, f1, ...) with const references to the fields of an aggregate, found
+ * with structured bindings after detecting the field count.
+ */
+template<Reflectable T, typename F>
+constexpr decltype(auto) visit_fields(T const& value, F&& visit)
+{
+  constexpr std::size_t n = detail::aggregate_arity<T>();
+  if constexpr (n == 0) { return visit(); }
+  else if constexpr (n == 1) { auto const& [f0] = value; return visit(f0); }
+  else if constexpr (n == 2) { auto const& [f0, f1] = value; return visit(f0, f1); }
+  else if constexpr (n == 3) { auto const& [f0, f1, f2] = value; return visit(f0, f1, f2); }
+  else if constexpr (n == 4) { auto const& [f0, f1, f2, f3] = value; return visit(f0, f1, f2, f3); }
+  else if constexpr (n == 5) { auto const& [f0, f1, f2, f3, f4] = value; return visit(f0, f1, f2, f3, f4); }
+  else if constexpr (n == 6) { auto const& [f0, f1, f2, f3, f4, f5] = value; return visit(f0, f1, f2, f3, f4, f5); }
+  else if constexpr (n == 7) { auto const& [f0, f1, f2, f3, f4, f5, f6] = value; return visit(f0, f1, f2, f3, f4, f5, f6); }
+  else if constexpr (n == 8) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7); }
+  else if constexpr (n == 9) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8); }
+  else if constexpr (n == 10) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9); }
+  else if constexpr (n == 11) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10); }
+  else if constexpr (n == 12) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11); }
+  else if constexpr (n == 13) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12); }
+  else if constexpr (n == 14) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13); }
+  else if constexpr (n == 15) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14); }
+  else if constexpr (n == 16) { auto const& [f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15] = value; return visit(f0, f1, f2, f3, f4, f5, f6, f7, f8, f9, f10, f11, f12, f13, f14, f15); }
+}
+
 template<typename T> concept StdOutStreamable = requires(T t) {std::cout << t;};
 template<typename T> concept OutStreamable = requires(std::ostream os, T t) {os << t;};
 template<typename T> concept InStreamable = requires(std::istream os, T t) {os >> t;};
 
-template<typename T> concept Printable = StdOutStreamable<T> || Container<T>;
+namespace detail {
+template<typename... Ts> struct type_list {};
+
+/** type_list of the field types of a Reflectable type, without references and const. */
+template<Reflectable T>
+using field_types = decltype(visit_fields(std::declval<T const&>(), [](auto const& ... fields) {
+  return type_list<std::remove_cvref_t<decltype(fields)>...>{};
+}));
+
+// a concept cannot refer to itself, so the recursion into elements and fields is done here
+template<typename T> consteval bool printable();
+
+template<typename... Ts>
+consteval bool all_printable(type_list<Ts...>) { return (printable<Ts>() && ...); }
+
+template<typename T>
+consteval bool printable()
+{
+  if constexpr (StdOutStreamable<T>) { return true; }
+  else if constexpr (Container<T>) { return printable<std::remove_cvref_t<decltype(*std::begin(std::declval<T const&>()))>>(); }
+  else if constexpr (Reflectable<T>) { return all_printable(field_types<T>{}); }
+  else { return false; }
+}
+}
+
+/**
+ * can be printed with print: streamable types, containers of Printable elements and
+ * aggregates whose fields are all Printable.
+ */
+template<typename T> concept Printable = detail::printable<T>();
 
 
 template<char sep, char end> static void print();
@@ -72,218 +278,4665 @@ struct HumanReadableTime{
 // ------------------------ IMPLEMENTATIONS ---------------------------- //
 
 
+/**
+ * Growable character buffer with allocation-free appends once it has reached its
+ * working size. Numbers are formatted with std::to_chars, so the output does not
+ * depend on the locale and no temporary strings are created.
+ */
+class FormatBuffer
+{
+    std::unique_ptr<char[]> data_;
+    std::size_t size_ = 0;
+    std::size_t capacity_ = 0;
+
+    char* grow(std::size_t n)
+    {
+        if (size_ + n > capacity_) { reserve(std::max(2*capacity_, size_ + n)); }
+        char* out = data_.get() + size_;
+        size_ += n;
+        return out;
+    }
+
+public:
+    explicit FormatBuffer(std::size_t capacity=4096) { reserve(capacity); }
+
+    void reserve(std::size_t capacity)
+    {
+        if (capacity <= capacity_) { return; }
+        std::unique_ptr<char[]> data(new char[capacity]);
+        if (size_ != 0) { std::memcpy(data.get(), data_.get(), size_); }
+        data_ = std::move(data);
+        capacity_ = capacity;
+    }
+
+    void clear() { size_ = 0; }
+    [[nodiscard]] std::size_t size() const { return size_; }
+    [[nodiscard]] char const* data() const { return data_.get(); }
+    [[nodiscard]] std::string_view view() const { return {data_.get(), size_}; }
+
+    FormatBuffer& append(std::string_view text)
+    {
+        if (not text.empty()) { std::memcpy(grow(text.size()), text.data(), text.size()); }
+        return *this;
+    }
+
+    FormatBuffer& append(char c)
+    {
+        *grow(1) = c;
+        return *this;
+    }
+
+    template<std::integral T> requires (not std::same_as<T, bool> and not std::same_as<T, char>)
+    FormatBuffer& append(T value)
+    {
+        char tmp[48];
+        auto const result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        return append(std::string_view(tmp, static_cast<std::size_t>(result.ptr - tmp)));
+    }
+
+    /** shortest representation that round-trips. */
+    template<std::floating_point T>
+    FormatBuffer& append(T value)
+    {
+        char tmp[64];
+        auto const result = std::to_chars(tmp, tmp + sizeof(tmp), value);
+        return append(std::string_view(tmp, static_cast<std::size_t>(result.ptr - tmp)));
+    }
+
+    /** printf-like formatting, e.g. std::chars_format::general with precision 6 gives "%g". */
+    template<std::floating_point T>
+    FormatBuffer& append(T value, std::chars_format format, int precision)
+    {
+        char tmp[128];
+        auto const result = std::to_chars(tmp, tmp + sizeof(tmp), value, format, precision);
+        return append(std::string_view(tmp, static_cast<std::size_t>(result.ptr - tmp)));
+    }
+};
+
+namespace detail {
+/** the output of one print call is assembled here and written with a single call. */
+inline FormatBuffer& print_buffer()
+{
+  thread_local FormatBuffer buffer;
+  return buffer;
+}
+
+inline void flush_print_buffer(FormatBuffer& buffer)
+{
+  std::cout.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+  buffer.clear();
+}
+
+/**
+ * numbers are formatted with to_chars, which gives what std::cout gives with its
+ * default flags. If the flags were changed, numbers go through the stream instead.
+ */
+inline bool cout_has_default_format()
+{
+  return std::cout.flags() == (std::ios_base::dec | std::ios_base::skipws) and std::cout.precision() == 6 and
+         std::cout.width() == 0;
+}
+
+template<ContiguousContainer C>
+void append_container(FormatBuffer& out, C const& container, bool plain);
+template<RandomAccessContainer C>
+void append_container(FormatBuffer& out, C const& container, bool plain);
+template<typename C>
+void append_container(FormatBuffer& out, C const& container, bool plain);
+
+template<typename T>
+void append_printable(FormatBuffer& out, T const& value, bool plain)
+{
+  if constexpr (std::same_as<T, char> or std::same_as<T, signed char> or std::same_as<T, unsigned char>) {
+    out.append(static_cast<char>(value));
+  }
+  else if constexpr (std::is_arithmetic_v<T>) {
+    if (not plain) {
+      flush_print_buffer(out);
+      std::cout << value;
+    }
+    else if constexpr (std::same_as<T, bool>) { out.append(value ? '1' : '0'); }
+    else if constexpr (std::floating_point<T>) { out.append(value, std::chars_format::general, 6); }
+    else { out.append(value); }
+  }
+  else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+    out.append(std::string_view(value));
+  }
+  else if constexpr (StdOutStreamable<T>) {
+    flush_print_buffer(out);
+    std::cout << value;
+  }
+  else if constexpr (Container<T>) {
+    append_container(out, value, plain);
+  }
+  else {
+    out.append('{');
+    visit_fields(value, [&out, plain](auto const& ... fields) {
+      bool first = true;
+      ((out.append(first ? "" : ", "), first = false, append_printable(out, fields, plain)), ...);
+    });
+    out.append('}');
+  }
+}
+
+/** rough characters per element, to reserve the output of sized containers in one go. */
+template<typename C>
+constexpr std::size_t printed_size_estimate = std::is_arithmetic_v<std::remove_cvref_t<decltype(*std::begin(std::declval<C const&>()))>> ? 8 : 16;
+
+template<typename T>
+void append_elements(FormatBuffer& out, T const* data, std::size_t size, bool plain)
+{
+  out.append('{');
+  for (std::size_t i = 0; i < size; ++i) {
+    if (i != 0) { out.append(", "); }
+    append_printable(out, data[i], plain);
+  }
+  out.append('}');
+}
+
+/** pointer and size kernel for contiguous data. */
+template<ContiguousContainer C>
+void append_container(FormatBuffer& out, C const& container, bool plain)
+{
+  std::size_t const size = std::size(container);
+  out.reserve(out.size() + 2 + size*printed_size_estimate<C>);
+  append_elements(out, std::data(container), size, plain);
+}
+
+template<RandomAccessContainer C>
+void append_container(FormatBuffer& out, C const& container, bool plain)
+{
+  std::size_t const size = std::size(container);
+  out.reserve(out.size() + 2 + size*printed_size_estimate<C>);
+  auto const first = std::begin(container);
+  out.append('{');
+  for (std::size_t i = 0; i < size; ++i) {
+    if (i != 0) { out.append(", "); }
+    append_printable(out, first[static_cast<std::ptrdiff_t>(i)], plain);
+  }
+  out.append('}');
+}
+
+template<typename C>
+void append_container(FormatBuffer& out, C const& container, bool plain)
+{
+  if constexpr (SizedContainer<C>) { out.reserve(out.size() + 2 + std::size(container)*printed_size_estimate<C>); }
+  out.append('{');
+  bool first = true;
+  for (auto const& elem : container) {
+    if (not first) { out.append(", "); }
+    first = false;
+    append_printable(out, elem, plain);
+  }
+  out.append('}');
+}
+}
 
 template<char sep=' ', char end='\n'>
 [[maybe_unused]] void print() { std::cout << end; }
 
+/**
+ * prints a container as {1, 2, 3}, followed by end. Strings are printed as text.
+ */
 template<char sep=' ', char end='\n'>
 [[maybe_unused]] void print(Container auto const & output)
 {
-  print<sep, ' '>('{');
-  auto const & last_elem = *(output.end()-1);
-  for (const auto& elem : output) {
-    if (elem != last_elem){
-      print<sep, ' '>(elem, ',');
-    }
-    else{
-      print<sep, end>(elem, '}');
-    }
-  }
+  FormatBuffer& out = detail::print_buffer();
+  detail::append_printable(out, output, detail::cout_has_default_format());
+  out.append(end);
+  detail::flush_print_buffer(out);
 }
 
 
 /**
  * Print function that can take an arbitrary number of arguments. It was implemented to work similarly to Pythons print function.
+ * Every argument is followed by sep and the line by end. The whole line is assembled in a
+ * thread-local buffer and written with one call, so contiguous containers are formatted
+ * through a pointer-and-size loop and sized containers reserve their output up front.
  * @tparam Tfirst Type of the first argument (automatically deduced)
  * @tparam Trest Type of the remaining part of the variadic number of arguments (automatically deduced)
  * @param first First argument
  * @param rest rest of the variadic arguments
  * @returns nothing.
- * @see print(const C<T, std::allocator<T>>& output)
- * @attention can not handle containers of containers.
- * @warning if a container of zero length is provided the code will crush.
+ * @see print(Container auto const & output)
  */
-//template<typename Tfirst, typename... Trest>
-//[[maybe_unused]] void print(const Tfirst& first, const Trest& ... rest)
 template<char sep=' ', char end='\n'>
 [[maybe_unused]] void print(Printable auto const & first, Printable auto const & ... rest)
 {
-  if constexpr (StdOutStreamable<decltype(first)>){
-      std::cout<<first<<sep;
-  }
-  else{
-      print<sep, ' '>(first);
-  }
-  print<sep, end>(rest...);
+  FormatBuffer& out = detail::print_buffer();
+  bool const plain = detail::cout_has_default_format();
+  detail::append_printable(out, first, plain);
+  out.append(sep);
+  ((detail::append_printable(out, rest, plain), out.append(sep)), ...);
+  out.append(end);
+  detail::flush_print_buffer(out);
 }
 
 /**
- * given a time difference in the highest clock resolution this struct constructs a human readable string of elapsed time.
+ * string literal usable as a template argument, e.g. print<"x = {}">(x).
  */
-static HumanReadableTime human_readable_time(long long diff){
-    std::string unit;
-    std::string unit_fine;
-    long long diff_ns = diff;
-    long long diff_fine = diff;
-    double diff_d = static_cast<double>(diff);
-    if (diff_d/(1.e3l)<1.l) { unit = " ns"; }
-    else if (diff_d/1.e6<1.) {
-        unit = " µs";
-        diff /= 1000;
-    }
-    else if (diff_d/1.e9<1.) {
-        unit = " ms";
-        diff /= 1000'000ll;
-        unit_fine = " µs";
-        diff_fine /= 1000ll;
-    }
-    else if (diff_d/(1.e9l*60.l)<1.l) {
-        unit = " s";
-        diff /= 1000'000'000ll;
-        unit_fine = " ms";
-        diff_fine /= 1000'000ll;
-    }
-    else if (diff_d/(1.e9*3600.)<1.) {
-        unit = " m";
-        diff /= 60'000'000'000ll;
-        unit_fine = " s";
-        diff_fine /= 1000'000'000ll;
-    }
-    else {
-        unit = " h";
-        diff /= 3600'000'000'000ll;
-        unit_fine = " m";
-        diff_fine /= 60'000'000ll;
-    }
-    return {.unit=unit, .unit_fine=unit_fine, .diff=diff,
-            .diff_fine=diff_fine, .diff_ns=diff_ns};
-}
+template<std::size_t N>
+struct fixed_string {
+  char value[N]{};
 
-class Timer
-{
-/**
- * this class keeps time form its creation to destruction. I.e. it can
- * time the duration of a scope.
- *
- * */
-private:
-    using Clock =
-    std::conditional_t<std::chrono::high_resolution_clock::is_steady,
-                       std::chrono::high_resolution_clock,
-                       std::chrono::steady_clock>;
-    Clock::time_point Start = Clock::now();
-    Clock::time_point Now;
-    bool stopped=false;
-public:
-    [[maybe_unused]] Timer() = default;
-    void restart(){Start = Clock::now();}
-    HumanReadableTime stop()
-    {
-        Now = Clock::now();
-        long long diff_ = std::chrono::duration_cast<std::chrono::nanoseconds>(Now - Start).count();
+  constexpr fixed_string(char const (&text)[N]) { std::copy_n(text, N, value); }
+  [[nodiscard]] constexpr std::string_view view() const { return {value, N - 1}; }
+};
 
-        HumanReadableTime hrt = human_readable_time(diff_);
+namespace detail {
+/** a format string split at its {} placeholders, with {{ and }} already unescaped. */
+template<std::size_t N>
+struct split_format {
+  std::array<char, N> text{};          ///< the literal segments one after the other
+  std::array<std::size_t, N> ends{};   ///< end of segment i in text
+  std::size_t segments = 0;
+  bool valid = true;
+};
 
-        auto end = std::chrono::system_clock::now();
-        auto end_time = std::chrono::system_clock::to_time_t(end);
-        std::cout << "finished computation at " << std::ctime(&end_time)
-        << "elapsed time: " << hrt.diff << hrt.unit << " (" << hrt.diff_fine << hrt.unit_fine << ")" << '\n';
-        stopped = true;
-        return hrt;
-    }
+template<std::size_t N>
+consteval split_format<N> split(fixed_string<N> const& format)
+{
+  split_format<N> result;
+  std::string_view const f = format.view();
+  std::size_t out = 0;
+  for (std::size_t i = 0; i < f.size(); ++i) {
+    bool const doubled = i + 1 < f.size() and f[i + 1] == f[i];
+    if ((f[i] == '{' or f[i] == '}') and doubled) { result.text[out++] = f[i++]; }
+    else if (f[i] == '{' and i + 1 < f.size() and f[i + 1] == '}') { result.ends[result.segments++] = out; ++i; }
+    else if (f[i] == '{' or f[i] == '}') { result.valid = false; }
+    else { result.text[out++] = f[i]; }
+  }
+  result.ends[result.segments++] = out;
+  return result;
+}
 
-    ~Timer() { if(not stopped){stop();} }
-};
+template<fixed_string Format>
+inline constexpr auto split_format_v = split(Format);
 
+/** literal segment I of Format, a constant that appends as a fixed-size copy. */
+template<fixed_string Format, std::size_t I>
+inline constexpr std::string_view format_segment{
+  split_format_v<Format>.text.data() + (I == 0 ? 0 : split_format_v<Format>.ends[I - 1]),
+  split_format_v<Format>.ends[I] - (I == 0 ? 0 : split_format_v<Format>.ends[I - 1])};
+}
 
-template<typename G>
-concept UniformRandomBitGenerator = requires(G g) {
-  typename G::result_type; // Must have result_type
-  { G::min() } -> std::same_as<typename G::result_type>; // min function
-  { G::max() } -> std::same_as<typename G::result_type>; // max function
-  { g() } -> std::same_as<typename G::result_type>; // operator()
-  requires std::is_unsigned_v<typename G::result_type>; // result_type is unsigned integer type
-  requires G::min() < G::max(); // min is strictly less than max
+/**
+ * prints args into the {} placeholders of Format, followed by a newline. Format is
+ * checked and split at compile time, so at runtime the literal text is copied with
+ * constant sizes and only the arguments are formatted. {{ and }} print a brace.
+ */
+template<fixed_string Format, Printable... Args>
+[[maybe_unused]] void print(Args const & ... args)
+{
+  static_assert(detail::split_format_v<Format>.valid, "lone { or } in the format string, write {{ or }} for a brace");
+  static_assert(detail::split_format_v<Format>.segments == sizeof...(Args) + 1,
+                "the number of {} placeholders does not match the number of arguments");
+  FormatBuffer& out = detail::print_buffer();
+  bool const plain = detail::cout_has_default_format();
+  out.append(detail::format_segment<Format, 0>);
+  [&]<std::size_t... I>(std::index_sequence<I...>) {
+    ((detail::append_printable(out, args, plain), out.append(detail::format_segment<Format, I + 1>)), ...);
+  }(std::index_sequence_for<Args...>{});
+  out.append('\n');
+  detail::flush_print_buffer(out);
+}
+
+/** what LOG and LOGN put in front of a line, combine with |. */
+enum class LogPrefix : unsigned {
+  none = 0,
+  location = 1,       ///< file name and line, e.g. main.cpp:12
+  function = 2,       ///< function signature as given by std::source_location
+  wall_time = 4,      ///< UTC time, e.g. 2026-10-17T12:00:00.123456Z
+  monotonic_time = 8, ///< steady clock seconds since the first prefixed line, e.g. 12.345678
+  thread = 16         ///< thread_index() of the calling thread, e.g. t1
 };
 
+constexpr LogPrefix operator|(LogPrefix a, LogPrefix b)
+{
+  return static_cast<LogPrefix>(static_cast<unsigned>(a) | static_cast<unsigned>(b));
+}
 
-template <typename E>
-concept RandomNumberEngine = requires(E e, const E x, const E y, typename E::result_type s, unsigned long long z, std::ostream& os, std::istream& is) {
-  typename E::result_type;
-  { E() } -> std::same_as<E>;
-  { E(x) } -> std::same_as<E>;
-  { E(s) } -> std::same_as<E>;
-  { e.seed() } -> std::same_as<void>;
-  { e.seed(s) } -> std::same_as<void>;
-  { e() } -> std::same_as<typename E::result_type>;
-  { e.discard(z) } -> std::same_as<void>;
-  { x == y } -> std::same_as<bool>;
-  { x != y } -> std::same_as<bool>;
-  { os << x } -> std::same_as<std::ostream&>;
-  { is >> e } -> std::same_as<std::istream&>;
-  { E::min() } -> std::same_as<typename E::result_type>;
-  { E::max() } -> std::same_as<typename E::result_type>;
-};
+namespace detail {
+constexpr bool has_prefix(LogPrefix flags, LogPrefix flag)
+{
+  return (static_cast<unsigned>(flags) & static_cast<unsigned>(flag)) != 0;
+}
 
+/** small id of the calling thread, 1 for the first thread that asks, 2 for the next and so on. */
+inline std::uint32_t thread_index()
+{
+  static std::atomic<std::uint32_t> next{1};
+  thread_local std::uint32_t const index = next.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
 
-// source https://en.wikipedia.org/wiki/Xorshift#xoshiro_and_xoroshiro
-//template<typename ResultType=uint32_t>
-//requires std::is_integral<ResultType>::value
-//requires std::is_same_v<ResultType, uint32_t>
-class xorshift32
+inline std::int64_t steady_ns()
 {
-  using ResultType = uint32_t;
-  ResultType seed_;
-public:
-  typedef ResultType result_type;
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-  xorshift32(): seed_(12) { }
+inline std::atomic<LogPrefix>& log_prefix_flags()
+{
+  static std::atomic<LogPrefix> flags{LogPrefix::none};
+  return flags;
+}
 
-  explicit xorshift32(ResultType seed_): seed_(seed_) { }
+/** location of one LOG call site, formatted once when the call site runs for the first time. */
+class LogSite
+{
+  char location_[96];
+  std::size_t location_size_ = 0;
+  std::string_view function_;
 
-  /* The state word must be initialized to non-zero */
-  ResultType operator()()
-  {
-    /* Algorithm "xor" from p. 4 of Marsaglia, "Xorshift RNGs" */
-    ResultType x = seed_;
-    x ^= x << 13;
-    x ^= x >> 17;
-    x ^= x << 5;
-    return seed_ = x;
-  }
-  void discard(long long z)
+public:
+  explicit LogSite(std::source_location const& where)
+    : function_(where.function_name())
   {
-    for (long long i = 0; i<z; ++i) {
-      (*this)();
-    }
+    std::string_view file(where.file_name());
+    if (auto const slash = file.find_last_of("/\\"); slash != std::string_view::npos) { file.remove_prefix(slash + 1); }
+    file = file.substr(0, sizeof(location_) - 12);
+    std::memcpy(location_, file.data(), file.size());
+    location_[file.size()] = ':';
+    auto const end = std::to_chars(location_ + file.size() + 1, location_ + sizeof(location_), where.line()).ptr;
+    location_size_ = static_cast<std::size_t>(end - location_);
   }
-  constexpr static ResultType min() { return std::numeric_limits<ResultType>::min(); }
-  constexpr static ResultType max() { return std::numeric_limits<ResultType>::max(); }
 
-  void seed(){*this = xorshift32();}
-  void seed(ResultType seed_inp){*this = xorshift32(seed_inp);}
+  /** file name without directories and line, e.g. main.cpp:12 */
+  [[nodiscard]] std::string_view location() const { return {location_, location_size_}; }
+  [[nodiscard]] std::string_view function() const { return function_; }
+};
 
-  bool operator==(xorshift32 const& rhs) const{
-    return seed_==rhs.seed_;
+/**
+ * per thread text of the last second that was printed, so a timestamp costs one clock read,
+ * a compare and two copies unless the second has changed since the last line of this thread.
+ */
+struct LogClockCache {
+  std::int64_t second = std::numeric_limits<std::int64_t>::min();
+  char text[32];
+  std::size_t size = 0;
+};
+
+/** appends 2026-10-17T12:00:00.123456Z */
+inline void append_wall_time(FormatBuffer& out)
+{
+  thread_local LogClockCache cache;
+  auto const us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  std::int64_t const second = us >= 0 ? us/1000000 : (us - 999999)/1000000;
+  if (second != cache.second) {
+    std::chrono::sys_seconds const tp{std::chrono::seconds(second)};
+    auto const day = std::chrono::floor<std::chrono::days>(tp);
+    std::chrono::year_month_day const date{day};
+    std::chrono::hh_mm_ss const time{tp - day};
+    int const fields[6] = {static_cast<int>(date.year()), static_cast<int>(static_cast<unsigned>(date.month())),
+                           static_cast<int>(static_cast<unsigned>(date.day())), static_cast<int>(time.hours().count()),
+                           static_cast<int>(time.minutes().count()), static_cast<int>(time.seconds().count())};
+    char const separators[6] = {'-', '-', 'T', ':', ':', '.'};
+    char* p = cache.text;
+    for (int i = 0; i < 6; ++i) {
+      if (i != 0 and fields[i] < 10) { *p++ = '0'; }
+      p = std::to_chars(p, cache.text + sizeof(cache.text), fields[i]).ptr;
+      *p++ = separators[i];
+    }
+    cache.size = static_cast<std::size_t>(p - cache.text);
+    cache.second = second;
   }
-  bool operator!=(xorshift32 const& rhs) const{
-    return seed_!=rhs.seed_;
+  out.append(std::string_view(cache.text, cache.size));
+  char fraction[7];
+  for (long long rest = us - second*1000000, i = 5; i >= 0; --i, rest /= 10) { fraction[i] = static_cast<char>('0' + rest%10); }
+  fraction[6] = 'Z';
+  out.append(std::string_view(fraction, 7));
+}
+
+/** appends the steady clock seconds since the first call, e.g. 12.345678 */
+inline void append_monotonic_time(FormatBuffer& out)
+{
+  static std::int64_t const start = steady_ns();
+  thread_local LogClockCache cache;
+  std::int64_t const us = (steady_ns() - start)/1000;
+  std::int64_t const second = us/1000000;
+  if (second != cache.second) {
+    char* p = std::to_chars(cache.text, cache.text + sizeof(cache.text), second).ptr;
+    *p++ = '.';
+    cache.size = static_cast<std::size_t>(p - cache.text);
+    cache.second = second;
   }
+  out.append(std::string_view(cache.text, cache.size));
+  char fraction[6];
+  for (long long rest = us%1000000, i = 5; i >= 0; --i, rest /= 10) { fraction[i] = static_cast<char>('0' + rest%10); }
+  out.append(std::string_view(fraction, 6));
+}
 
+/** appends e.g. "[2026-10-17T12:00:00.123456Z t1 main.cpp:12 int main()] ", or nothing without flags. */
+inline void append_log_prefix(FormatBuffer& out, LogSite const& site)
+{
+  LogPrefix const flags = log_prefix_flags().load(std::memory_order_relaxed);
+  if (flags == LogPrefix::none) { return; }
+  char separator = '[';
+  if (has_prefix(flags, LogPrefix::wall_time)) { out.append(std::exchange(separator, ' ')); append_wall_time(out); }
+  if (has_prefix(flags, LogPrefix::monotonic_time)) { out.append(std::exchange(separator, ' ')); append_monotonic_time(out); }
+  if (has_prefix(flags, LogPrefix::thread)) { out.append(std::exchange(separator, ' ')).append('t').append(thread_index()); }
+  if (has_prefix(flags, LogPrefix::location)) { out.append(std::exchange(separator, ' ')).append(site.location()); }
+  if (has_prefix(flags, LogPrefix::function)) { out.append(std::exchange(separator, ' ')).append(site.function()); }
+  out.append("] ");
+}
+}
+
+/**
+ * sets the prefix of the lines of LOG and LOGN for all threads, e.g.
+ * set_log_prefix(LogPrefix::wall_time | LogPrefix::thread | LogPrefix::location).
+ */
+inline void set_log_prefix(LogPrefix flags) { detail::log_prefix_flags().store(flags, std::memory_order_relaxed); }
+
+[[nodiscard]] inline LogPrefix log_prefix() { return detail::log_prefix_flags().load(std::memory_order_relaxed); }
+
+namespace detail {
+/** LOG: the prefix of the call site followed by what print(args...) prints. */
+template<Printable... Args>
+void log_line(LogSite const& site, Args const & ... args)
+{
+  FormatBuffer& out = print_buffer();
+  append_log_prefix(out, site);
+  if constexpr (sizeof...(Args) == 0) {
+    out.append('\n');
+    flush_print_buffer(out);
+  }
+  else { print(args...); }
+}
+
+/** LOGN: the prefix of the call site, the name of the variable and what print(value) prints. */
+template<Printable T>
+void log_named(LogSite const& site, std::string_view name, T const & value)
+{
+  FormatBuffer& out = print_buffer();
+  append_log_prefix(out, site);
+  out.append(name).append(": ");
+  print(value);
+}
+}
+
+namespace detail {
+/** ostream target that appends to a FormatBuffer, to capture operator<< output without a std::string. */
+class FormatBufferStreambuf : public std::streambuf
+{
+  FormatBuffer* out_ = nullptr;
+
+protected:
+  int_type overflow(int_type c) override
+  {
+    if (not traits_type::eq_int_type(c, traits_type::eof())) { out_->append(traits_type::to_char_type(c)); }
+    return traits_type::not_eof(c);
+  }
+
+  std::streamsize xsputn(char const* s, std::streamsize n) override
+  {
+    out_->append(std::string_view(s, static_cast<std::size_t>(n)));
+    return n;
+  }
+
+public:
+  void target(FormatBuffer& out) { out_ = &out; }
+};
+
+inline void append_json_escape(FormatBuffer& out, char c)
+{
+  switch (c) {
+    case '"': out.append("\\\""); break;
+    case '\\': out.append("\\\\"); break;
+    case '\n': out.append("\\n"); break;
+    case '\r': out.append("\\r"); break;
+    case '\t': out.append("\\t"); break;
+    case '\b': out.append("\\b"); break;
+    case '\f': out.append("\\f"); break;
+    default: {
+      constexpr char hex[] = "0123456789abcdef";
+      auto const u = static_cast<unsigned char>(c);
+      char const escaped[6] = {'\\', 'u', '0', '0', hex[u >> 4], hex[u & 15]};
+      out.append(std::string_view(escaped, 6));
+    }
+  }
+}
+
+/**
+ * appends text as a quoted JSON string. Quotes, backslashes and control characters are
+ * escaped, everything else, including UTF-8 sequences, is copied as is. With SSE2 the text
+ * is scanned 16 bytes at a time and clean blocks are copied in one go.
+ */
+inline void append_json_string(FormatBuffer& out, std::string_view text)
+{
+  out.reserve(out.size() + text.size() + 2);
+  out.append('"');
+  char const* p = text.data();
+  char const* const end = p + text.size();
+#if defined(__SSE2__)
+  __m128i const quote = _mm_set1_epi8('"');
+  __m128i const backslash = _mm_set1_epi8('\\');
+  __m128i const control = _mm_set1_epi8(0x1F);
+  while (end - p >= 16) {
+    __m128i const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(p));
+    __m128i const special = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash)),
+                                         _mm_cmpeq_epi8(_mm_min_epu8(chunk, control), chunk));
+    auto const mask = static_cast<unsigned>(_mm_movemask_epi8(special));
+    if (mask == 0) {
+      out.append(std::string_view(p, 16));
+      p += 16;
+      continue;
+    }
+    auto const clean = static_cast<std::size_t>(std::countr_zero(mask));
+    out.append(std::string_view(p, clean));
+    append_json_escape(out, p[clean]);
+    p += clean + 1;
+  }
+#endif
+  char const* run = p;
+  for (; p != end; ++p) {
+    auto const u = static_cast<unsigned char>(*p);
+    if (u >= 0x20 and u != '"' and u != '\\') { continue; }
+    out.append(std::string_view(run, static_cast<std::size_t>(p - run)));
+    append_json_escape(out, *p);
+    run = p + 1;
+  }
+  out.append(std::string_view(run, static_cast<std::size_t>(end - run)));
+  out.append('"');
+}
+
+/**
+ * appends a value as JSON: numbers and bools as such, non-finite floats as null, text and
+ * operator<< output as strings, containers and aggregates as arrays.
+ */
+template<typename T>
+void append_json(FormatBuffer& out, T const& value)
+{
+  if constexpr (std::same_as<T, bool>) { out.append(value ? "true" : "false"); }
+  else if constexpr (std::same_as<T, char> or std::same_as<T, signed char> or std::same_as<T, unsigned char>) {
+    char const c = static_cast<char>(value);
+    append_json_string(out, std::string_view(&c, 1));
+  }
+  else if constexpr (std::integral<T>) { out.append(value); }
+  else if constexpr (std::floating_point<T>) {
+    if (std::isfinite(value)) { out.append(value); }
+    else { out.append("null"); }
+  }
+  else if constexpr (std::is_convertible_v<T const&, std::string_view>) {
+    append_json_string(out, std::string_view(value));
+  }
+  else if constexpr (StdOutStreamable<T>) {
+    thread_local FormatBuffer scratch(256);
+    thread_local FormatBufferStreambuf streambuf;
+    thread_local std::ostream stream(&streambuf);
+    scratch.clear();
+    streambuf.target(scratch);
+    stream << value;
+    append_json_string(out, scratch.view());
+  }
+  else if constexpr (Container<T>) {
+    if constexpr (SizedContainer<T>) { out.reserve(out.size() + 2 + std::size(value)*printed_size_estimate<T>); }
+    out.append('[');
+    bool first = true;
+    for (auto const& elem : value) {
+      if (not first) { out.append(','); }
+      first = false;
+      append_json(out, elem);
+    }
+    out.append(']');
+  }
+  else {
+    out.append('[');
+    visit_fields(value, [&out](auto const& ... fields) {
+      bool first = true;
+      ((out.append(first ? "" : ","), first = false, append_json(out, fields)), ...);
+    });
+    out.append(']');
+  }
+}
+
+/**
+ * {"ts":<unix time in seconds with microseconds>,"tid":<thread_index()>, and for LOG calls
+ * "loc" and "func" if they are selected with set_log_prefix.
+ */
+inline void append_json_record_head(FormatBuffer& out, LogSite const* site=nullptr)
+{
+  auto const us = std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+  out.append("{\"ts\":");
+  out.append(us/1000000);
+  char fraction[7] = {'.', '0', '0', '0', '0', '0', '0'};
+  for (long long rest = us%1000000, i = 6; i > 0; --i, rest /= 10) { fraction[i] = static_cast<char>('0' + rest%10); }
+  out.append(std::string_view(fraction, 7));
+  out.append(",\"tid\":");
+  out.append(thread_index());
+  out.append(',');
+  if (site == nullptr) { return; }
+  LogPrefix const flags = log_prefix_flags().load(std::memory_order_relaxed);
+  if (has_prefix(flags, LogPrefix::location)) {
+    out.append("\"loc\":");
+    append_json_string(out, site->location());
+    out.append(',');
+  }
+  if (has_prefix(flags, LogPrefix::function)) {
+    out.append("\"func\":");
+    append_json_string(out, site->function());
+    out.append(',');
+  }
+}
+
+template<Printable... Args>
+void write_json_record(LogSite const* site, Args const & ... args)
+{
+  FormatBuffer& out = print_buffer();
+  append_json_record_head(out, site);
+  out.append("\"args\":[");
+  [[maybe_unused]] bool first = true;
+  ((out.append(first ? "" : ","), first = false, append_json(out, args)), ...);
+  out.append("]}\n");
+  flush_print_buffer(out);
+}
+
+template<Printable T>
+void write_json_named_record(LogSite const* site, std::string_view name, T const & value)
+{
+  FormatBuffer& out = print_buffer();
+  append_json_record_head(out, site);
+  out.append("\"name\":");
+  append_json_string(out, name);
+  out.append(",\"value\":");
+  append_json(out, value);
+  out.append("}\n");
+  flush_print_buffer(out);
+}
+}
+
+/**
+ * prints one NDJSON record, e.g. {"ts":1700000000.123456,"tid":1,"args":["x",1,[1,2]]}.
+ * The record is assembled in the print buffer and written with one call. LOG uses this
+ * when LOG_JSON is defined to 1.
+ */
+template<Printable... Args>
+[[maybe_unused]] void print_json(Args const & ... args)
+{
+  detail::write_json_record(nullptr, args...);
+}
+
+/**
+ * prints one NDJSON record with a name, e.g. {"ts":1700000000.123456,"tid":1,"name":"v","value":[1,2]}.
+ * LOGN uses this when LOG_JSON is defined to 1.
+ */
+template<Printable T>
+[[maybe_unused]] void print_json_named(std::string_view name, T const & value)
+{
+  detail::write_json_named_record(nullptr, name, value);
+}
+
+namespace detail {
+/** call site state of LOG_EVERY_N. The call counter also gives the number of skipped lines. */
+struct LogEveryN {
+  std::atomic<std::uint64_t> calls{0};
+
+  bool should_log(std::uint64_t n, std::uint64_t& suppressed)
+  {
+    std::uint64_t const call = calls.fetch_add(1, std::memory_order_relaxed);
+    if (n > 1 and call%n != 0) { return false; }
+    suppressed = call == 0 ? 0 : std::max<std::uint64_t>(n, 1) - 1;
+    return true;
+  }
+};
+
+/** call site state of LOG_FIRST_N. Once n lines are out, a call is a single relaxed load. */
+struct LogFirstN {
+  std::atomic<std::uint64_t> calls{0};
+
+  bool should_log(std::uint64_t n, std::uint64_t&)
+  {
+    if (calls.load(std::memory_order_relaxed) >= n) { return false; }
+    return calls.fetch_add(1, std::memory_order_relaxed) < n;
+  }
+};
+
+/**
+ * count of the lines a time based call site dropped. Every thread counts in a thread_local
+ * of the call site and adds to the shared count only every 1024 lines, so a dropped line
+ * does not write to a cache line the other threads read. The reported count misses up to
+ * 1023 lines of every other thread.
+ */
+struct LogSkipCounter {
+  static constexpr std::uint64_t publish_every = 1024;
+  std::atomic<std::uint64_t> skipped{0};
+
+  void skip(std::uint64_t& pending)
+  {
+    if (++pending == publish_every) {
+      skipped.fetch_add(pending, std::memory_order_relaxed);
+      pending = 0;
+    }
+  }
+
+  std::uint64_t take(std::uint64_t& pending)
+  {
+    std::uint64_t const own = std::exchange(pending, 0);
+    if (skipped.load(std::memory_order_relaxed) == 0) { return own; }
+    return own + skipped.exchange(0, std::memory_order_relaxed);
+  }
+};
+
+/** longest interval the time based call sites handle, about 31 years, so that sums cannot overflow. */
+inline constexpr std::int64_t max_log_interval_ns = 1'000'000'000'000'000'000;
+
+/**
+ * call site state of LOG_EVERY_T, the steady clock time before which nothing is logged.
+ * A dropped line costs a clock read and one relaxed load.
+ */
+struct LogEveryT {
+  std::atomic<std::int64_t> next_ns{0};
+  LogSkipCounter skipped;
+
+  template<typename Rep, typename Period>
+  bool should_log(std::chrono::duration<Rep, Period> period, std::uint64_t& pending, std::uint64_t& suppressed)
+  {
+    std::int64_t const now = steady_ns();
+    std::int64_t next = next_ns.load(std::memory_order_relaxed);
+    if (now < next) {
+      skipped.skip(pending);
+      return false;
+    }
+    auto const nanoseconds = std::chrono::duration_cast<std::chrono::duration<double, std::nano>>(period).count();
+    auto const step = nanoseconds >= 0 ? static_cast<std::int64_t>(std::min(nanoseconds, double(max_log_interval_ns))) : 0;
+    if (not next_ns.compare_exchange_strong(next, now + step, std::memory_order_relaxed)) {
+      skipped.skip(pending);
+      return false;
+    }
+    suppressed = skipped.take(pending);
+    return true;
+  }
+};
+
+/**
+ * call site state of LOG_RATELIMITED. The token bucket is kept as a single theoretical
+ * arrival time (GCRA): every line moves it one interval into the future and a line is
+ * allowed while it is at most burst - 1 intervals ahead of now, which is the same as a
+ * bucket of burst tokens refilled at per_second. A dropped line costs a clock read and
+ * one relaxed load. A rate that is not positive, or NaN, never refills, so only the
+ * first burst lines are logged.
+ */
+struct LogRateLimit {
+  std::atomic<std::int64_t> arrival_ns{0};
+  LogSkipCounter skipped;
+
+  bool should_log(double per_second, std::uint64_t burst, std::uint64_t& pending, std::uint64_t& suppressed)
+  {
+    std::int64_t const now = steady_ns();
+    std::int64_t arrival = arrival_ns.load(std::memory_order_relaxed);
+    // !(x > 0) also catches NaN; tiny rates are clamped so the interval fits
+    double const interval_ns = per_second > 0 ? 1e9/per_second : double(max_log_interval_ns);
+    auto const interval = static_cast<std::int64_t>(std::clamp(interval_ns, 1.0, double(max_log_interval_ns)));
+    std::uint64_t const extra = std::max<std::uint64_t>(burst, 1) - 1;
+    std::int64_t const tolerance = extra > static_cast<std::uint64_t>(max_log_interval_ns/interval) ?
+                                   max_log_interval_ns : interval*static_cast<std::int64_t>(extra);
+    do {
+      if (now < arrival - tolerance) {
+        skipped.skip(pending);
+        return false;
+      }
+    } while (not arrival_ns.compare_exchange_weak(arrival, std::max(arrival, now) + interval, std::memory_order_relaxed));
+    suppressed = skipped.take(pending);
+    return true;
+  }
+};
+}
+
+/**
+ * given a time difference in the highest clock resolution this struct constructs a human readable string of elapsed time.
+ */
+static HumanReadableTime human_readable_time(long long diff){
+    std::string unit;
+    std::string unit_fine;
+    long long diff_ns = diff;
+    long long diff_fine = diff;
+    double diff_d = static_cast<double>(diff);
+    if (diff_d/(1.e3l)<1.l) { unit = " ns"; }
+    else if (diff_d/1.e6<1.) {
+        unit = " µs";
+        diff /= 1000;
+    }
+    else if (diff_d/1.e9<1.) {
+        unit = " ms";
+        diff /= 1000'000ll;
+        unit_fine = " µs";
+        diff_fine /= 1000ll;
+    }
+    else if (diff_d/(1.e9l*60.l)<1.l) {
+        unit = " s";
+        diff /= 1000'000'000ll;
+        unit_fine = " ms";
+        diff_fine /= 1000'000ll;
+    }
+    else if (diff_d/(1.e9*3600.)<1.) {
+        unit = " m";
+        diff /= 60'000'000'000ll;
+        unit_fine = " s";
+        diff_fine /= 1000'000'000ll;
+    }
+    else {
+        unit = " h";
+        diff /= 3600'000'000'000ll;
+        unit_fine = " m";
+        diff_fine /= 60'000'000ll;
+    }
+    return {.unit=unit, .unit_fine=unit_fine, .diff=diff,
+            .diff_fine=diff_fine, .diff_ns=diff_ns};
+}
+
+class Timer
+{
+/**
+ * this class keeps time form its creation to destruction. I.e. it can
+ * time the duration of a scope.
+ *
+ * */
+private:
+    using Clock =
+    std::conditional_t<std::chrono::high_resolution_clock::is_steady,
+                       std::chrono::high_resolution_clock,
+                       std::chrono::steady_clock>;
+    Clock::time_point Start = Clock::now();
+    Clock::time_point Now;
+    bool stopped=false;
+public:
+    [[maybe_unused]] Timer() = default;
+    void restart(){Start = Clock::now();}
+    HumanReadableTime stop()
+    {
+        Now = Clock::now();
+        long long diff_ = std::chrono::duration_cast<std::chrono::nanoseconds>(Now - Start).count();
+
+        HumanReadableTime hrt = human_readable_time(diff_);
+
+        auto end = std::chrono::system_clock::now();
+        auto end_time = std::chrono::system_clock::to_time_t(end);
+        std::cout << "finished computation at " << std::ctime(&end_time)
+        << "elapsed time: " << hrt.diff << hrt.unit << " (" << hrt.diff_fine << hrt.unit_fine << ")" << '\n';
+        stopped = true;
+        return hrt;
+    }
+
+    ~Timer() { if(not stopped){stop();} }
+};
+
+
+/**
+ * keeps the compiler from optimizing away the computation of value in a benchmark.
+ */
+template<typename T>
+inline void do_not_optimize(T const& value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static_cast<void>(*static_cast<T const volatile*>(&value));
+#endif
+}
+
+/**
+ * size in bytes of the largest cache of the highest level, read from sysfs.
+ * Falls back to 64 MiB if sysfs is not available.
+ */
+inline std::size_t last_level_cache_size()
+{
+    static std::size_t const size = [] {
+        std::size_t best_level = 0;
+        std::size_t best_size = 0;
+        std::error_code ec;
+        std::filesystem::path const dir = "/sys/devices/system/cpu/cpu0/cache";
+        for (auto const& entry : std::filesystem::directory_iterator(dir, ec)) {
+            std::size_t level = 0;
+            std::string size_text;
+            std::ifstream(entry.path() / "level") >> level;
+            std::ifstream(entry.path() / "size") >> size_text;
+            if (size_text.empty()) { continue; }
+            std::size_t bytes = 0;
+            auto const result = std::from_chars(size_text.data(), size_text.data() + size_text.size(), bytes);
+            if (result.ptr != size_text.data() + size_text.size()) {
+                switch (*result.ptr) {
+                    case 'K': bytes <<= 10u; break;
+                    case 'M': bytes <<= 20u; break;
+                    case 'G': bytes <<= 30u; break;
+                    default: break;
+                }
+            }
+            if (level > best_level or (level == best_level and bytes > best_size)) {
+                best_level = level;
+                best_size = bytes;
+            }
+        }
+        return best_size != 0 ? best_size : std::size_t{64} << 20u;
+    }();
+    return size;
+}
+
+/**
+ * evicts the caches by writing and reading a buffer twice the size of the last level cache.
+ */
+inline void thrash_caches()
+{
+    static std::vector<unsigned char> buffer(2*last_level_cache_size());
+    constexpr std::size_t line = 64;
+    unsigned sum = 0;
+    for (std::size_t i = 0; i < buffer.size(); i += line) {
+        buffer[i] = static_cast<unsigned char>(buffer[i] + 1);
+        sum += buffer[i];
+    }
+    do_not_optimize(sum);
+}
+
+/**
+ * writes back and invalidates all cache lines that hold [data, data+bytes).
+ * Does nothing on architectures without a user space cache flush instruction.
+ */
+inline void flush_cache_lines(void const* data, std::size_t bytes)
+{
+    constexpr std::size_t line = 64;
+    auto const* p = static_cast<char const*>(data);
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+    for (std::size_t i = 0; i < bytes; i += line) { _mm_clflush(p + i); }
+    if (bytes != 0) { _mm_clflush(p + bytes - 1); }
+    _mm_mfence();
+#elif defined(__aarch64__)
+    for (std::size_t i = 0; i < bytes; i += line) { asm volatile("dc civac, %0" : : "r"(p + i) : "memory"); }
+    asm volatile("dsb ish" : : : "memory");
+#else
+    static_cast<void>(p);
+    static_cast<void>(bytes);
+#endif
+}
+
+/**
+ * options of benchmark(). Every repetition is run once with warm caches and once
+ * with cold caches unless one of the two is switched off. Caches are made cold by
+ * thrashing a buffer larger than the last level cache, by flushing the input, or both.
+ *
+ * To reduce noise the benchmark thread can be pinned to pin_cpu. Independently of
+ * that, raise_priority runs it as SCHED_FIFO with realtime_priority. The default of 1
+ * is the lowest real-time level, enough to keep normal threads from preempting the
+ * benchmark while kernel threads and interrupt handlers, which run higher, still
+ * get the CPU. A repetition counts as an outlier if it is more than
+ * outlier_threshold median absolute deviations above the median or if an
+ * interrupt hit its CPU while it ran.
+ */
+struct BenchmarkOptions {
+    std::size_t repetitions = 10;
+    bool warm = true;
+    bool cold = true;
+    bool thrash = true;
+    bool flush = true;
+    bool print = true;
+    int pin_cpu = -1;
+    bool raise_priority = false;
+    int realtime_priority = 1;
+    double outlier_threshold = 5.0;
+};
+
+/**
+ * the machine state a benchmark ran in, recorded so that results can be compared.
+ */
+struct BenchmarkEnvironment {
+    int cpu = -1;
+    bool pinned = false;
+    bool realtime_priority = false;
+    std::string governor;
+    std::string turbo;
+    std::string kernel;
+    unsigned hardware_threads = std::thread::hardware_concurrency();
+    std::size_t last_level_cache = last_level_cache_size();
+};
+
+/**
+ * timings of the repetitions of one cache state, all in nanoseconds.
+ */
+struct BenchmarkStats {
+    std::vector<long long> samples;
+    std::vector<long long> interrupts; ///< interrupts on the benchmark CPU per repetition, if known
+    std::vector<std::size_t> outliers; ///< indices of repetitions that are not representative
+    std::size_t interrupted_outliers = 0; ///< outliers during which the CPU served extra interrupts
+    long long min = 0;
+    long long median = 0;
+    long long mean = 0;
+    long long max = 0;
+
+    explicit BenchmarkStats(std::vector<long long> ns = {}, std::vector<long long> irqs = {}, double threshold = 5.0)
+        : samples(std::move(ns)), interrupts(std::move(irqs))
+    {
+        if (samples.empty()) { return; }
+        std::vector<long long> sorted = samples;
+        std::sort(sorted.begin(), sorted.end());
+        min = sorted.front();
+        max = sorted.back();
+        median = sorted[sorted.size()/2];
+        long double total = 0;
+        for (long long v : sorted) { total += static_cast<long double>(v); }
+        mean = static_cast<long long>(total / static_cast<long double>(sorted.size()));
+
+        std::vector<long long> deviations;
+        deviations.reserve(sorted.size());
+        for (long long v : sorted) { deviations.push_back(v > median ? v - median : median - v); }
+        std::sort(deviations.begin(), deviations.end());
+        // 1.4826 scales the MAD to the standard deviation of normally distributed data
+        double const mad = std::max(1.4826*static_cast<double>(deviations[deviations.size()/2]), 1.0);
+        // a repetition that saw more interrupts than the quietest one only needs to be mildly slow
+        long long const quiet = interrupts.empty() ? 0 : *std::min_element(interrupts.begin(), interrupts.end());
+        for (std::size_t i = 0; i < samples.size(); ++i) {
+            double const excess = static_cast<double>(samples[i] - median);
+            bool const interrupted = i < interrupts.size() and interrupts[i] > quiet;
+            if (excess > threshold*mad or (interrupted and excess > mad)) {
+                outliers.push_back(i);
+                if (interrupted) { ++interrupted_outliers; }
+            }
+        }
+    }
+};
+
+struct BenchmarkResult {
+    std::string name;
+    BenchmarkEnvironment environment;
+    BenchmarkStats warm;
+    BenchmarkStats cold;
+};
+
+inline std::ostream& operator<<(std::ostream& os, BenchmarkStats const& stats)
+{
+    auto field = [&os](char const* label, long long ns) {
+        HumanReadableTime hrt = human_readable_time(ns);
+        if (hrt.unit_fine.empty()) { os << label << hrt.diff << hrt.unit; }
+        else { os << label << hrt.diff_fine << hrt.unit_fine; }
+    };
+    field("min ", stats.min);
+    field(", median ", stats.median);
+    field(", mean ", stats.mean);
+    field(", max ", stats.max);
+    if (not stats.outliers.empty()) {
+        os << " (" << stats.outliers.size() << " outliers";
+        if (stats.interrupted_outliers != 0) { os << ", " << stats.interrupted_outliers << " interrupted"; }
+        os << ')';
+    }
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, BenchmarkEnvironment const& env)
+{
+    os << "cpu " << (env.cpu >= 0 ? std::to_string(env.cpu) : std::string("?")) << (env.pinned ? " (pinned)" : "")
+       << ", priority " << (env.realtime_priority ? "realtime" : "normal")
+       << ", governor " << (env.governor.empty() ? "unknown" : env.governor)
+       << ", turbo " << (env.turbo.empty() ? "unknown" : env.turbo)
+       << ", " << env.hardware_threads << " threads, llc " << (env.last_level_cache >> 10u) << " KiB";
+    if (not env.kernel.empty()) { os << ", kernel " << env.kernel; }
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, BenchmarkResult const& result)
+{
+    os << "benchmark " << result.name << '\n';
+    os << "  environment: " << result.environment << '\n';
+    if (not result.warm.samples.empty()) { os << "  warm cache: " << result.warm << '\n'; }
+    if (not result.cold.samples.empty()) { os << "  cold cache: " << result.cold << '\n'; }
+    return os;
+}
+
+namespace detail {
+inline std::string read_first_line(std::filesystem::path const& path)
+{
+    std::string line;
+    std::ifstream in(path);
+    std::getline(in, line);
+    return line;
+}
+
+/**
+ * number of interrupts one CPU has served, from /proc/interrupts. The file is kept open
+ * and re-read with pread(2) into a buffer sized once at construction, so a reading
+ * between making the caches cold and the timed run neither allocates nor goes through
+ * iostreams and only touches that buffer.
+ */
+class InterruptCounter
+{
+    int fd_ = -1;
+    std::size_t column_ = 0;
+    std::unique_ptr<char[]> buffer_;
+    std::size_t capacity_ = 0;
+
+    /** reads the whole file, or returns an empty view if it does not fit. */
+    std::string_view read_file()
+    {
+#if defined(__linux__)
+        std::size_t size = 0;
+        while (size < capacity_) {
+            ssize_t const n = pread(fd_, buffer_.get() + size, capacity_ - size, static_cast<off_t>(size));
+            if (n < 0 and errno == EINTR) { continue; }
+            if (n < 0) { return {}; }
+            if (n == 0) { return {buffer_.get(), size}; }
+            size += static_cast<std::size_t>(n);
+        }
+#endif
+        return {};
+    }
+
+public:
+    explicit InterruptCounter(int cpu)
+    {
+#if defined(__linux__)
+        if (cpu < 0) { return; }
+        fd_ = open("/proc/interrupts", O_RDONLY | O_CLOEXEC);
+        if (fd_ < 0) { return; }
+        // /proc files do not report a size; grow until the file fits, then leave room for new lines
+        std::string_view text;
+        for (capacity_ = 1u << 14u; capacity_ <= (1u << 26u); capacity_ *= 2) {
+            buffer_.reset(new char[capacity_]);
+            if (not (text = read_file()).empty()) { break; }
+        }
+        // the header names the CPUs; interrupts of offline CPUs are not listed
+        std::string_view header = text.substr(0, text.find('\n'));
+        char name[16] = "CPU";
+        std::string_view const column(name, static_cast<std::size_t>(std::to_chars(name + 3, name + sizeof(name), cpu).ptr - name));
+        bool found = false;
+        for (std::size_t position = 0; (position = header.find("CPU", position)) != std::string_view::npos; ++column_) {
+            std::size_t const stop = std::min(header.find_first_of(" \t", position), header.size());
+            if (header.substr(position, stop - position) == column) { found = true; break; }
+            position = stop;
+        }
+        if (not found) {
+            close(fd_);
+            fd_ = -1;
+            return;
+        }
+        capacity_ = 2*text.size() + 4096;
+        buffer_.reset(new char[capacity_]);
+#else
+        static_cast<void>(cpu);
+#endif
+    }
+
+    InterruptCounter(InterruptCounter const&) = delete;
+    InterruptCounter& operator=(InterruptCounter const&) = delete;
+
+    ~InterruptCounter()
+    {
+#if defined(__linux__)
+        if (fd_ >= 0) { close(fd_); }
+#endif
+    }
+
+    [[nodiscard]] bool valid() const { return fd_ >= 0; }
+
+    /** interrupts served so far, or -1 if they cannot be read. */
+    long long count()
+    {
+        if (not valid()) { return -1; }
+        std::string_view text = read_file();
+        if (text.empty()) { return -1; }
+        text.remove_prefix(std::min(text.size(), text.find('\n')));
+        long long total = 0;
+        while (not text.empty()) {
+            text.remove_prefix(1);
+            std::string_view const line = text.substr(0, text.find('\n'));
+            text.remove_prefix(line.size());
+            std::size_t p = line.find(':');
+            if (p == std::string_view::npos) { continue; }
+            ++p;
+            for (std::size_t i = 0; i <= column_; ++i) {
+                p = line.find_first_not_of(" \t", p);
+                if (p == std::string_view::npos) { break; }
+                long long value = 0;
+                auto const result = std::from_chars(line.data() + p, line.data() + line.size(), value);
+                if (result.ec != std::errc{}) { break; }
+                if (i == column_) { total += value; }
+                p = static_cast<std::size_t>(result.ptr - line.data());
+            }
+        }
+        return total;
+    }
+};
+}
+
+/**
+ * pins the calling thread to one CPU and optionally gives it real-time priority
+ * for the lifetime of the object, and records the resulting environment. The
+ * previous affinity and scheduling policy are restored on destruction.
+ */
+class BenchmarkEnvironmentGuard
+{
+    BenchmarkEnvironment env_;
+#if defined(__linux__)
+    cpu_set_t old_affinity_{};
+    bool restore_affinity_ = false;
+    int old_policy_ = SCHED_OTHER;
+    sched_param old_param_{};
+    bool restore_policy_ = false;
+#endif
+public:
+    explicit BenchmarkEnvironmentGuard(int pin_cpu=-1, bool raise_priority=false, int realtime_priority=1)
+    {
+#if defined(__linux__)
+        if (pin_cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(pin_cpu, &set);
+            restore_affinity_ = sched_getaffinity(0, sizeof(old_affinity_), &old_affinity_) == 0;
+            env_.pinned = sched_setaffinity(0, sizeof(set), &set) == 0;
+            if (not env_.pinned) { std::cerr << "benchmark: could not pin to cpu " << pin_cpu << '\n'; }
+        }
+        if (raise_priority) {
+            restore_policy_ = pthread_getschedparam(pthread_self(), &old_policy_, &old_param_) == 0;
+            sched_param param{};
+            param.sched_priority = std::clamp(realtime_priority, sched_get_priority_min(SCHED_FIFO),
+                                              sched_get_priority_max(SCHED_FIFO));
+            env_.realtime_priority = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+            if (not env_.realtime_priority) {
+                std::cerr << "benchmark: could not raise priority (needs CAP_SYS_NICE)\n";
+            }
+        }
+        env_.cpu = sched_getcpu();
+        std::filesystem::path const cpu_dir = "/sys/devices/system/cpu";
+        env_.governor = detail::read_first_line(cpu_dir / ("cpu" + std::to_string(std::max(env_.cpu, 0))) /
+                                                "cpufreq" / "scaling_governor");
+        if (std::string no_turbo = detail::read_first_line(cpu_dir / "intel_pstate" / "no_turbo"); not no_turbo.empty()) {
+            env_.turbo = no_turbo == "1" ? "off" : "on";
+        }
+        else if (std::string boost = detail::read_first_line(cpu_dir / "cpufreq" / "boost"); not boost.empty()) {
+            env_.turbo = boost == "1" ? "on" : "off";
+        }
+        utsname name{};
+        if (uname(&name) == 0) { env_.kernel = name.release; }
+#else
+        static_cast<void>(pin_cpu);
+        static_cast<void>(raise_priority);
+        static_cast<void>(realtime_priority);
+#endif
+        if (not env_.governor.empty() and env_.governor != "performance") {
+            std::cerr << "benchmark: cpu frequency governor is '" << env_.governor
+                      << "', results may drift; use the 'performance' governor\n";
+        }
+        if (env_.turbo == "on") {
+            std::cerr << "benchmark: turbo boost is on, results depend on temperature and load\n";
+        }
+    }
+
+    BenchmarkEnvironmentGuard(BenchmarkEnvironmentGuard const&) = delete;
+    BenchmarkEnvironmentGuard& operator=(BenchmarkEnvironmentGuard const&) = delete;
+
+    [[nodiscard]] BenchmarkEnvironment const& environment() const { return env_; }
+
+    ~BenchmarkEnvironmentGuard()
+    {
+#if defined(__linux__)
+        if (restore_policy_ and env_.realtime_priority) { pthread_setschedparam(pthread_self(), old_policy_, &old_param_); }
+        if (restore_affinity_ and env_.pinned) { sched_setaffinity(0, sizeof(old_affinity_), &old_affinity_); }
+#endif
+    }
+};
+
+/**
+ * times kernel() with warm and with cold caches.
+ * @param name printed in the report.
+ * @param kernel the code to measure; its result, if any, is kept alive with do_not_optimize.
+ * @param input the memory the kernel reads; it is flushed from the caches before each cold repetition.
+ */
+template<typename F>
+BenchmarkResult benchmark(std::string name, F&& kernel, std::span<std::byte const> input={},
+                          BenchmarkOptions const& options={})
+{
+    using Clock = std::chrono::steady_clock;
+    BenchmarkEnvironmentGuard guard(options.pin_cpu, options.raise_priority, options.realtime_priority);
+    detail::InterruptCounter interrupts(guard.environment().pinned ? guard.environment().cpu : -1);
+    bool const count_interrupts = interrupts.count() >= 0;
+
+    auto run = [&kernel] {
+        if constexpr (std::is_void_v<std::invoke_result_t<F&>>) { kernel(); }
+        else { do_not_optimize(kernel()); }
+    };
+    auto time_once = [&](std::vector<long long>& ns, std::vector<long long>& irqs) {
+        long long const irqs_before = count_interrupts ? interrupts.count() : 0;
+        auto const start = Clock::now();
+        run();
+        auto const stop = Clock::now();
+        ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count());
+        if (count_interrupts) { irqs.push_back(interrupts.count() - irqs_before); }
+    };
+
+    BenchmarkResult result;
+    result.name = std::move(name);
+    result.environment = guard.environment();
+    if (options.warm) {
+        std::vector<long long> ns;
+        std::vector<long long> irqs;
+        ns.reserve(options.repetitions);
+        run();
+        for (std::size_t i = 0; i < options.repetitions; ++i) { time_once(ns, irqs); }
+        result.warm = BenchmarkStats(std::move(ns), std::move(irqs), options.outlier_threshold);
+    }
+    if (options.cold) {
+        std::vector<long long> ns;
+        std::vector<long long> irqs;
+        ns.reserve(options.repetitions);
+        for (std::size_t i = 0; i < options.repetitions; ++i) {
+            if (options.thrash) { thrash_caches(); }
+            if (options.flush) { flush_cache_lines(input.data(), input.size()); }
+            time_once(ns, irqs);
+        }
+        result.cold = BenchmarkStats(std::move(ns), std::move(irqs), options.outlier_threshold);
+    }
+    if (options.print) { std::cout << result; }
+    return result;
+}
+
+
+#if defined(__linux__)
+/**
+ * Statistical profiler for code that is too large to instrument with Timers.
+ * Like Timer it works on a scope: the constructor starts sampling call stacks on
+ * SIGPROF (setitimer/ITIMER_PROF) and stop() or the destructor writes the collected
+ * stacks in Brendan Gregg's folded format ("main;foo;bar 42" per line), ready for
+ * flamegraph.pl. ITIMER_PROF counts the CPU time of the whole process and the kernel
+ * delivers the signal to one of its running threads, so the profile covers all
+ * threads, weighted by the CPU time they use, not only the one that created it.
+ *
+ * The signal handler only calls backtrace() into a preallocated buffer and
+ * claims its slot with an atomic counter, so it never locks or allocates.
+ * Only one profiler can be active at a time.
+ */
+class SamplingProfiler
+{
+public:
+    static constexpr int max_depth = 64;
+    static constexpr std::size_t max_samples = 1u << 16u;
+
+private:
+    struct Sample {
+        int depth;
+        void* frames[max_depth];
+    };
+
+    // claimed_ makes the profiler exclusive, active_ is what the handler sees once the buffer exists
+    static inline std::atomic<bool> claimed_{false};
+    static inline std::atomic<SamplingProfiler*> active_{nullptr};
+    static inline std::atomic<int> in_flight_{0};
+
+    std::unique_ptr<Sample[]> samples_;
+    std::atomic<std::size_t> next_{0};
+    std::atomic<std::size_t> dropped_{0};
+    std::string path_;
+    struct sigaction old_action_{};
+    bool stopped=true;
+
+    static void on_signal(int)
+    {
+        int const saved_errno = errno;
+        in_flight_.fetch_add(1);
+        if (SamplingProfiler* self = active_.load()) {
+            std::size_t i = self->next_.fetch_add(1, std::memory_order_relaxed);
+            if (i < max_samples) {
+                Sample& s = self->samples_[i];
+                s.depth = backtrace(s.frames, max_depth);
+            }
+            else {
+                self->dropped_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+        in_flight_.fetch_sub(1);
+        errno = saved_errno;
+    }
+
+    static std::string symbol_name(void* address)
+    {
+        Dl_info info{};
+        if (dladdr(address, &info) != 0 and info.dli_sname != nullptr) {
+            int status = 0;
+            std::unique_ptr<char, decltype(&std::free)> demangled(
+                abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status), &std::free);
+            return status == 0 ? std::string(demangled.get()) : std::string(info.dli_sname);
+        }
+        char buffer[2 + 2*sizeof(void*) + 1];
+        std::snprintf(buffer, sizeof(buffer), "%p", address);
+        std::string name = buffer;
+        if (info.dli_fname != nullptr) {
+            std::string module = info.dli_fname;
+            name = module.substr(module.find_last_of('/') + 1) + "+" + name;
+        }
+        return name;
+    }
+
+public:
+    /**
+     * @param path file the folded stacks are written to when sampling stops.
+     * @param frequency_hz sampling frequency in samples per second of CPU time.
+     */
+    explicit SamplingProfiler(std::string path="profile.folded", int frequency_hz=999)
+        : path_(std::move(path))
+    {
+        // backtrace() loads libgcc lazily, which must not happen inside the handler
+        void* warmup[1];
+        backtrace(warmup, 1);
+
+        if (claimed_.exchange(true)) {
+            std::cerr << "SamplingProfiler: another profiler is already active\n";
+            return;
+        }
+        // only the active profiler pays for the sample buffer
+        samples_.reset(new Sample[max_samples]);
+        active_.store(this);
+        struct sigaction action{};
+        action.sa_handler = &SamplingProfiler::on_signal;
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGPROF, &action, &old_action_);
+
+        long const interval_us = 1000'000l / std::max(frequency_hz, 1);
+        itimerval timer{};
+        timer.it_interval.tv_sec = interval_us / 1000'000l;
+        timer.it_interval.tv_usec = interval_us % 1000'000l;
+        timer.it_value = timer.it_interval;
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        stopped = false;
+    }
+
+    SamplingProfiler(SamplingProfiler const&) = delete;
+    SamplingProfiler& operator=(SamplingProfiler const&) = delete;
+
+    /** number of samples taken so far, including the ones that did not fit into the buffer. */
+    [[nodiscard]] std::size_t sample_count() const { return next_.load(std::memory_order_relaxed); }
+
+    /**
+     * stops sampling and writes the folded stacks to the path given at construction.
+     */
+    void stop()
+    {
+        if (stopped) { return; }
+        itimerval timer{};
+        setitimer(ITIMER_PROF, &timer, nullptr);
+        active_.store(nullptr);
+        while (in_flight_.load() != 0) { std::this_thread::yield(); }
+        sigaction(SIGPROF, &old_action_, nullptr);
+        claimed_.store(false);
+        stopped = true;
+
+        std::ofstream out(path_);
+        write_folded(out);
+        std::cout << "profiler: " << std::min(sample_count(), max_samples) << " samples written to " << path_;
+        if (dropped_ != 0) { std::cout << " (" << dropped_ << " dropped, buffer full)"; }
+        std::cout << '\n';
+    }
+
+    /**
+     * writes one line per distinct stack, root frame first, followed by the number of samples.
+     * Call only after stop().
+     */
+    void write_folded(std::ostream& os) const
+    {
+        // the two innermost frames are on_signal and the kernel's signal trampoline
+        constexpr int skipped_frames = 2;
+        std::unordered_map<void*, std::string> symbols;
+        std::map<std::string, std::size_t> stacks;
+        std::size_t const n = std::min(next_.load(), max_samples);
+        for (std::size_t i = 0; i < n; ++i) {
+            Sample const& s = samples_[i];
+            std::string stack;
+            for (int f = s.depth - 1; f >= skipped_frames; --f) {
+                auto it = symbols.find(s.frames[f]);
+                if (it == symbols.end()) {
+                    it = symbols.emplace(s.frames[f], symbol_name(s.frames[f])).first;
+                }
+                if (not stack.empty()) { stack += ';'; }
+                stack += it->second;
+            }
+            if (not stack.empty()) { ++stacks[stack]; }
+        }
+        for (auto const& [stack, count] : stacks) {
+            os << stack << ' ' << count << '\n';
+        }
+    }
+
+    ~SamplingProfiler() { stop(); }
+};
+
+
+/**
+ * Layout of the shared memory segment used by SharedMetrics. The segment starts
+ * with one MetricsHeader followed by `capacity` MetricSlots, each one cache line
+ * aligned. All integers are native endian, durations are in nanoseconds.
+ *
+ * Counters and gauges are single atomic words. Histograms are guarded by a
+ * seqlock: a writer makes `seq` odd with a compare-and-swap, which also keeps
+ * other writers out, updates the fields and makes it even again; a reader
+ * retries whenever it sees an odd or changed `seq`.
+ */
+struct MetricsHeader {
+    static constexpr std::uint64_t magic_value = 0x31534349'5254454dull; // "METRICS1"
+    static constexpr std::uint32_t version_value = 1;
+    std::uint64_t magic;
+    std::uint32_t version;
+    std::uint32_t capacity;
+    std::atomic<std::uint32_t> count;
+    std::uint32_t slot_size;
+};
+
+enum class MetricKind : std::uint32_t { counter = 1, gauge = 2, histogram = 3 };
+
+struct alignas(64) MetricSlot {
+    static constexpr std::size_t name_size = 56;
+    static constexpr std::size_t bucket_count = 64;
+    char name[name_size];
+    MetricKind kind;
+    std::uint32_t reserved;
+    std::atomic<std::uint64_t> seq;
+    std::atomic<std::uint64_t> value; ///< counter value, gauge bits or histogram count
+    std::atomic<std::uint64_t> sum;
+    std::atomic<std::uint64_t> min;
+    std::atomic<std::uint64_t> max;
+    std::atomic<std::uint64_t> buckets[bucket_count]; ///< bucket i counts values with bit_width i
+};
+
+/**
+ * consistent copy of one metric as seen by a reader.
+ */
+struct MetricSnapshot {
+    std::string name;
+    MetricKind kind;
+    std::uint64_t value;
+    double gauge;
+    std::uint64_t sum;
+    std::uint64_t min;
+    std::uint64_t max;
+    std::uint64_t buckets[MetricSlot::bucket_count];
+};
+
+namespace detail {
+inline void read_slot(MetricSlot const& slot, MetricSnapshot& snap)
+{
+    snap.name.assign(slot.name, strnlen(slot.name, MetricSlot::name_size));
+    snap.kind = slot.kind;
+    std::uint64_t before;
+    std::uint64_t after;
+    do {
+        before = slot.seq.load(std::memory_order_acquire);
+        snap.value = slot.value.load(std::memory_order_relaxed);
+        snap.sum = slot.sum.load(std::memory_order_relaxed);
+        snap.min = slot.min.load(std::memory_order_relaxed);
+        snap.max = slot.max.load(std::memory_order_relaxed);
+        for (std::size_t i = 0; i < MetricSlot::bucket_count; ++i) {
+            snap.buckets[i] = slot.buckets[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = slot.seq.load(std::memory_order_relaxed);
+    } while ((before & 1u) != 0 or before != after);
+    snap.gauge = std::bit_cast<double>(snap.value);
+}
+
+inline MetricSnapshot read_slot(MetricSlot const& slot)
+{
+    MetricSnapshot snap{};
+    read_slot(slot, snap);
+    return snap;
+}
+}
+
+/**
+ * Registry of counters, gauges and histograms that live in a POSIX shared memory
+ * segment, so that a separate process (see SharedMetricsReader) can watch them
+ * while the program runs.
+ *
+ * Creating the registry and registering metrics may allocate and make syscalls;
+ * updating a metric afterwards never enters the kernel. Counters and gauges are
+ * wait-free; threads recording into the same histogram take turns for a few
+ * dozen instructions. If the segment cannot
+ * be created the registry falls back to private memory, so the writers keep
+ * working and only the export is lost.
+ */
+class SharedMetrics
+{
+    MetricsHeader* header_ = nullptr;
+    MetricSlot* slots_ = nullptr;
+    std::size_t bytes_ = 0;
+    bool shared_ = false;
+    std::string name_;
+    MetricSlot overflow_{};
+    std::mutex registration_mutex_;
+
+    MetricSlot* slot(std::string_view name, MetricKind kind)
+    {
+        if (header_ == nullptr) { return &overflow_; }
+        // registration is rare; the lock keeps two threads from claiming the same slot
+        std::lock_guard lock(registration_mutex_);
+        std::uint32_t const n = header_->count.load(std::memory_order_acquire);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            if (slots_[i].kind == kind and
+                name.substr(0, MetricSlot::name_size - 1) == std::string_view(slots_[i].name)) {
+                return &slots_[i];
+            }
+        }
+        if (n == header_->capacity) {
+            std::cerr << "SharedMetrics: capacity exhausted, '" << name << "' is not exported\n";
+            return &overflow_;
+        }
+        MetricSlot& s = slots_[n];
+        std::size_t const len = std::min(name.size(), MetricSlot::name_size - 1);
+        std::memcpy(s.name, name.data(), len);
+        s.name[len] = '\0';
+        s.kind = kind;
+        s.min.store(kind == MetricKind::histogram ? ~std::uint64_t{0} : 0, std::memory_order_relaxed);
+        header_->count.store(n + 1, std::memory_order_release);
+        return &s;
+    }
+
+public:
+    class Counter {
+        MetricSlot* slot_;
+    public:
+        explicit Counter(MetricSlot* slot): slot_(slot) { }
+        void add(std::uint64_t n=1) { slot_->value.fetch_add(n, std::memory_order_relaxed); }
+    };
+
+    class Gauge {
+        MetricSlot* slot_;
+    public:
+        explicit Gauge(MetricSlot* slot): slot_(slot) { }
+        void set(double v) { slot_->value.store(std::bit_cast<std::uint64_t>(v), std::memory_order_relaxed); }
+    };
+
+    class Histogram {
+        MetricSlot* slot_;
+    public:
+        explicit Histogram(MetricSlot* slot): slot_(slot) { }
+        void record(std::uint64_t ns)
+        {
+            auto const relaxed = std::memory_order_relaxed;
+            // an even seq is free; making it odd locks out the other writers and tells readers to retry
+            std::uint64_t seq = slot_->seq.load(relaxed);
+            while ((seq & 1u) != 0 or
+                   not slot_->seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, relaxed)) {
+                if ((seq & 1u) != 0) {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+                    _mm_pause();
+#endif
+                    seq = slot_->seq.load(relaxed);
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_release);
+            slot_->value.store(slot_->value.load(relaxed) + 1, relaxed);
+            slot_->sum.store(slot_->sum.load(relaxed) + ns, relaxed);
+            if (ns < slot_->min.load(relaxed)) { slot_->min.store(ns, relaxed); }
+            if (ns > slot_->max.load(relaxed)) { slot_->max.store(ns, relaxed); }
+            auto& bucket = slot_->buckets[std::min<std::size_t>(std::bit_width(ns), MetricSlot::bucket_count - 1)];
+            bucket.store(bucket.load(relaxed) + 1, relaxed);
+            slot_->seq.store(seq + 2, std::memory_order_release);
+        }
+    };
+
+    /**
+     * records the lifetime of a scope into a histogram, like Timer but without printing.
+     */
+    class ScopedTiming {
+        using Clock = std::chrono::steady_clock;
+        Histogram histogram_;
+        Clock::time_point start_ = Clock::now();
+    public:
+        explicit ScopedTiming(Histogram histogram): histogram_(histogram) { }
+        ~ScopedTiming()
+        {
+            histogram_.record(static_cast<std::uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count()));
+        }
+    };
+
+    /**
+     * The segment is created exclusively: if another registry, or a crashed program, left a
+     * segment with the same name, it is neither truncated nor unlinked and this registry
+     * falls back to private memory. A stale segment can be removed from /dev/shm.
+     *
+     * @param name name of the shared memory object, e.g. "/my_program_metrics".
+     * @param capacity maximal number of metrics.
+     */
+    explicit SharedMetrics(std::string name="/cutils_metrics", std::uint32_t capacity=256)
+        : bytes_(sizeof(MetricSlot) + std::size_t{capacity}*sizeof(MetricSlot)), name_(std::move(name))
+    {
+        static_assert(sizeof(MetricsHeader) <= sizeof(MetricSlot));
+        void* memory = MAP_FAILED;
+        int fd = shm_open(name_.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+        bool const in_use = fd < 0 and errno == EEXIST;
+        if (fd >= 0) {
+            if (ftruncate(fd, static_cast<off_t>(bytes_)) == 0) {
+                memory = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            }
+            close(fd);
+            if (memory == MAP_FAILED) { shm_unlink(name_.c_str()); }
+        }
+        shared_ = memory != MAP_FAILED;
+        if (not shared_) {
+            if (in_use) {
+                std::cerr << "SharedMetrics: " << name_ << " is already in use, metrics are not exported\n";
+            }
+            else { std::cerr << "SharedMetrics: could not map " << name_ << ", metrics are not exported\n"; }
+            memory = mmap(nullptr, bytes_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (memory == MAP_FAILED) {
+                // without any memory the handles all point to one scratch slot and record nothing useful
+                std::cerr << "SharedMetrics: out of memory, metrics are disabled\n";
+                return;
+            }
+        }
+        // the header gets a whole slot so that the slots stay cache line aligned
+        header_ = new (memory) MetricsHeader{};
+        slots_ = new (static_cast<char*>(memory) + sizeof(MetricSlot)) MetricSlot[capacity]{};
+        header_->capacity = capacity;
+        header_->slot_size = sizeof(MetricSlot);
+        header_->version = MetricsHeader::version_value;
+        std::atomic_thread_fence(std::memory_order_release);
+        header_->magic = MetricsHeader::magic_value;
+    }
+
+    SharedMetrics(SharedMetrics const&) = delete;
+    SharedMetrics& operator=(SharedMetrics const&) = delete;
+
+    /** false if no memory could be mapped at all. The handles then still work but record nothing. */
+    [[nodiscard]] bool enabled() const { return header_ != nullptr; }
+
+    Counter counter(std::string_view name) { return Counter(slot(name, MetricKind::counter)); }
+    Gauge gauge(std::string_view name) { return Gauge(slot(name, MetricKind::gauge)); }
+    Histogram histogram(std::string_view name) { return Histogram(slot(name, MetricKind::histogram)); }
+
+    /**
+     * calls f with a consistent copy of every registered metric, in registration order.
+     * The same snapshot object is reused, so this does not allocate once the names fit.
+     */
+    template<typename F>
+    void visit(F&& f) const
+    {
+        thread_local MetricSnapshot snap{};
+        if (not enabled()) { return; }
+        std::uint32_t const n = header_->count.load(std::memory_order_acquire);
+        for (std::uint32_t i = 0; i < n; ++i) {
+            detail::read_slot(slots_[i], snap);
+            f(static_cast<MetricSnapshot const&>(snap));
+        }
+    }
+
+    /** consistent copies of all registered metrics, in registration order. */
+    [[nodiscard]] std::vector<MetricSnapshot> snapshot() const
+    {
+        std::vector<MetricSnapshot> result;
+        if (not enabled()) { return result; }
+        std::uint32_t const n = header_->count.load(std::memory_order_acquire);
+        result.reserve(n);
+        for (std::uint32_t i = 0; i < n; ++i) { result.push_back(detail::read_slot(slots_[i])); }
+        return result;
+    }
+
+    ~SharedMetrics()
+    {
+        if (header_ != nullptr) { munmap(header_, bytes_); }
+        if (shared_) { shm_unlink(name_.c_str()); }
+    }
+};
+
+/**
+ * read-only view of a segment written by SharedMetrics in another process.
+ */
+class SharedMetricsReader
+{
+    MetricsHeader const* header_ = nullptr;
+    MetricSlot const* slots_ = nullptr;
+    std::size_t bytes_ = 0;
+public:
+    explicit SharedMetricsReader(std::string const& name="/cutils_metrics")
+    {
+        int fd = shm_open(name.c_str(), O_RDONLY, 0);
+        if (fd < 0) { std::cerr << "SharedMetricsReader: no segment named " << name << '\n'; return; }
+        struct stat st{};
+        void* memory = MAP_FAILED;
+        if (fstat(fd, &st) == 0 and static_cast<std::size_t>(st.st_size) >= sizeof(MetricSlot)) {
+            bytes_ = static_cast<std::size_t>(st.st_size);
+            memory = mmap(nullptr, bytes_, PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (memory == MAP_FAILED) { return; }
+        auto const* header = static_cast<MetricsHeader const*>(memory);
+        if (header->magic != MetricsHeader::magic_value or header->version != MetricsHeader::version_value or
+            header->slot_size != sizeof(MetricSlot) or
+            bytes_ < sizeof(MetricSlot)*(std::size_t{header->capacity} + 1)) {
+            std::cerr << "SharedMetricsReader: " << name << " has an unknown layout\n";
+            munmap(memory, bytes_);
+            return;
+        }
+        header_ = header;
+        slots_ = reinterpret_cast<MetricSlot const*>(static_cast<char const*>(memory) + sizeof(MetricSlot));
+    }
+
+    SharedMetricsReader(SharedMetricsReader const&) = delete;
+    SharedMetricsReader& operator=(SharedMetricsReader const&) = delete;
+
+    [[nodiscard]] bool attached() const { return header_ != nullptr; }
+
+    [[nodiscard]] std::vector<MetricSnapshot> snapshot() const
+    {
+        std::vector<MetricSnapshot> result;
+        if (not attached()) { return result; }
+        std::uint32_t const n = std::min(header_->count.load(std::memory_order_acquire), header_->capacity);
+        result.reserve(n);
+        for (std::uint32_t i = 0; i < n; ++i) { result.push_back(detail::read_slot(slots_[i])); }
+        return result;
+    }
+
+    /** prints one line per metric; histograms show count, mean, min and max. */
+    void print(std::ostream& os=std::cout) const
+    {
+        for (MetricSnapshot const& m : snapshot()) {
+            os << m.name << ": ";
+            switch (m.kind) {
+                case MetricKind::counter: os << m.value; break;
+                case MetricKind::gauge: os << m.gauge; break;
+                case MetricKind::histogram: {
+                    if (m.value == 0) { os << "no samples"; break; }
+                    HumanReadableTime mean = human_readable_time(static_cast<long long>(m.sum / m.value));
+                    HumanReadableTime min = human_readable_time(static_cast<long long>(m.min));
+                    HumanReadableTime max = human_readable_time(static_cast<long long>(m.max));
+                    os << "count " << m.value << ", mean " << mean.diff << mean.unit
+                       << ", min " << min.diff << min.unit << ", max " << max.diff << max.unit;
+                    break;
+                }
+            }
+            os << '\n';
+        }
+    }
+
+    ~SharedMetricsReader() { if (attached()) { munmap(const_cast<MetricsHeader*>(header_), bytes_); } }
+};
+
+
+namespace detail {
+inline void append_metric_name(FormatBuffer& out, std::string_view name)
+{
+    for (std::size_t i = 0; i < name.size(); ++i) {
+        char const c = name[i];
+        bool const valid = (c >= 'a' and c <= 'z') or (c >= 'A' and c <= 'Z') or c == '_' or c == ':' or
+                           (i != 0 and c >= '0' and c <= '9');
+        out.append(valid ? c : '_');
+    }
+}
+
+/** OpenMetrics spells the non-finite values NaN, +Inf and -Inf. */
+inline void append_metric_value(FormatBuffer& out, double value)
+{
+    if (std::isnan(value)) { out.append("NaN"); }
+    else if (std::isinf(value)) { out.append(value > 0 ? "+Inf" : "-Inf"); }
+    else { out.append(value); }
+}
+}
+
+/**
+ * serializes all metrics of the registry in OpenMetrics text format into out.
+ * Histograms are exported in seconds with power of two bucket bounds up to the
+ * highest bucket that was ever hit.
+ */
+inline void write_openmetrics(SharedMetrics const& metrics, FormatBuffer& out)
+{
+    metrics.visit([&out](MetricSnapshot const& m) {
+        out.append("# TYPE ");
+        detail::append_metric_name(out, m.name);
+        switch (m.kind) {
+            case MetricKind::counter:
+                out.append(" counter\n");
+                detail::append_metric_name(out, m.name);
+                out.append("_total ").append(m.value).append('\n');
+                break;
+            case MetricKind::gauge:
+                out.append(" gauge\n");
+                detail::append_metric_name(out, m.name);
+                out.append(' ');
+                detail::append_metric_value(out, m.gauge);
+                out.append('\n');
+                break;
+            case MetricKind::histogram: {
+                out.append(" histogram\n");
+                std::size_t last = 0;
+                for (std::size_t i = 0; i < MetricSlot::bucket_count; ++i) { if (m.buckets[i] != 0) { last = i; } }
+                std::uint64_t cumulative = 0;
+                for (std::size_t i = 0; i <= last; ++i) {
+                    cumulative += m.buckets[i];
+                    detail::append_metric_name(out, m.name);
+                    out.append("_bucket{le=\"").append(static_cast<double>(std::uint64_t{1} << i)*1e-9)
+                       .append("\"} ").append(cumulative).append('\n');
+                }
+                detail::append_metric_name(out, m.name);
+                out.append("_bucket{le=\"+Inf\"} ").append(m.value).append('\n');
+                detail::append_metric_name(out, m.name);
+                out.append("_sum ").append(static_cast<double>(m.sum)*1e-9).append('\n');
+                detail::append_metric_name(out, m.name);
+                out.append("_count ").append(m.value).append('\n');
+                break;
+            }
+        }
+    });
+    out.append("# EOF\n");
+}
+
+/**
+ * writes the registry in OpenMetrics format to path. The text goes to tmp_path, which
+ * must be on the same file system, and is then renamed over path, so a collector never
+ * sees a partially written file. Nothing is allocated once buffer has its working size.
+ * @returns false if the file could not be written.
+ */
+inline bool write_openmetrics_file(SharedMetrics const& metrics, std::string const& path, std::string const& tmp_path,
+                                   FormatBuffer& buffer)
+{
+    buffer.clear();
+    write_openmetrics(metrics, buffer);
+    int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) { return false; }
+    std::size_t written = 0;
+    while (written < buffer.size()) {
+        ssize_t n = write(fd, buffer.data() + written, buffer.size() - written);
+        if (n < 0 and errno == EINTR) { continue; }
+        if (n <= 0) { break; }
+        written += static_cast<std::size_t>(n);
+    }
+    bool ok = written == buffer.size();
+    ok = (close(fd) == 0) and ok;
+    if (not ok or std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+/** as above, with path + ".tmp" as the temporary file. */
+inline bool write_openmetrics_file(SharedMetrics const& metrics, std::string const& path, FormatBuffer& buffer)
+{
+    return write_openmetrics_file(metrics, path, path + ".tmp", buffer);
+}
+
+/**
+ * periodically writes a SharedMetrics registry to an OpenMetrics text file from a
+ * background thread, e.g. for the node-exporter textfile collector. The file is
+ * written a last time when the exporter is destroyed.
+ */
+class OpenMetricsExporter
+{
+    SharedMetrics const& metrics_;
+    std::string path_;
+    std::string tmp_path_;
+    std::chrono::milliseconds interval_;
+    FormatBuffer buffer_;
+    std::mutex mutex_;
+    std::condition_variable_any wakeup_;
+    std::jthread worker_;
+
+    void run(std::stop_token stop)
+    {
+        std::unique_lock lock(mutex_);
+        while (not stop.stop_requested()) {
+            if (not write_openmetrics_file(metrics_, path_, tmp_path_, buffer_)) {
+                std::cerr << "OpenMetricsExporter: could not write " << path_ << '\n';
+            }
+            wakeup_.wait_for(lock, stop, interval_, [] { return false; });
+        }
+        write_openmetrics_file(metrics_, path_, tmp_path_, buffer_);
+    }
+
+public:
+    OpenMetricsExporter(SharedMetrics const& metrics, std::string path,
+                        std::chrono::milliseconds interval=std::chrono::seconds(15))
+        : metrics_(metrics), path_(std::move(path)), tmp_path_(path_ + ".tmp"), interval_(interval),
+          worker_([this](std::stop_token stop) { run(stop); }) { }
+
+    OpenMetricsExporter(OpenMetricsExporter const&) = delete;
+    OpenMetricsExporter& operator=(OpenMetricsExporter const&) = delete;
+};
+#endif
+
+
+template<typename G>
+concept UniformRandomBitGenerator = requires(G g) {
+  typename G::result_type; // Must have result_type
+  { G::min() } -> std::same_as<typename G::result_type>; // min function
+  { G::max() } -> std::same_as<typename G::result_type>; // max function
+  { g() } -> std::same_as<typename G::result_type>; // operator()
+  requires std::is_unsigned_v<typename G::result_type>; // result_type is unsigned integer type
+  requires G::min() < G::max(); // min is strictly less than max
+};
+
+
+template <typename E>
+concept RandomNumberEngine = requires(E e, const E x, const E y, typename E::result_type s, unsigned long long z, std::ostream& os, std::istream& is) {
+  typename E::result_type;
+  { E() } -> std::same_as<E>;
+  { E(x) } -> std::same_as<E>;
+  { E(s) } -> std::same_as<E>;
+  { e.seed() } -> std::same_as<void>;
+  { e.seed(s) } -> std::same_as<void>;
+  { e() } -> std::same_as<typename E::result_type>;
+  { e.discard(z) } -> std::same_as<void>;
+  { x == y } -> std::same_as<bool>;
+  { x != y } -> std::same_as<bool>;
+  { os << x } -> std::same_as<std::ostream&>;
+  { is >> e } -> std::same_as<std::istream&>;
+  { E::min() } -> std::same_as<typename E::result_type>;
+  { E::max() } -> std::same_as<typename E::result_type>;
+};
+
+
+namespace detail {
+/**
+ * square matrix over GF(2) acting on the bits of an unsigned word. Column j is the
+ * image of the j-th unit vector, so applying the matrix is an xor of the columns
+ * selected by the bits of the argument. Every xorshift step is such a linear map.
+ */
+template<std::unsigned_integral W>
+struct gf2_matrix {
+  static constexpr int bits = std::numeric_limits<W>::digits;
+  std::array<W, bits> columns{};
+
+  template<typename Step>
+  static constexpr gf2_matrix from_step(Step step)
+  {
+    gf2_matrix m;
+    for (int j = 0; j < bits; ++j) { m.columns[j] = step(W{1} << j); }
+    return m;
+  }
+
+  constexpr W operator()(W v) const
+  {
+    W result = 0;
+    for (int j = 0; j < bits; ++j) {
+      result ^= columns[j] & static_cast<W>(W{0} - ((v >> j) & 1u));
+    }
+    return result;
+  }
+
+  constexpr gf2_matrix operator*(gf2_matrix const& rhs) const
+  {
+    gf2_matrix m;
+    for (int j = 0; j < bits; ++j) { m.columns[j] = (*this)(rhs.columns[j]); }
+    return m;
+  }
+};
+
+/**
+ * the matrices step^(2^k) for k = 0 .. N-1, used to jump ahead by any distance
+ * with at most N matrix-vector products.
+ */
+template<std::unsigned_integral W, std::size_t N, typename Step>
+constexpr std::array<gf2_matrix<W>, N> gf2_power_table(Step step)
+{
+  std::array<gf2_matrix<W>, N> table;
+  table[0] = gf2_matrix<W>::from_step(step);
+  for (std::size_t k = 1; k < N; ++k) { table[k] = table[k-1]*table[k-1]; }
+  return table;
+}
+
+/**
+ * gf2_power_table for static locals. It is not constexpr so that the compiler does not
+ * constant-initialize the table in every translation unit, seconds for 64-bit words,
+ * while at runtime it is built once in microseconds.
+ */
+template<std::unsigned_integral W, std::size_t N, typename Step>
+std::array<gf2_matrix<W>, N> gf2_power_table_at_runtime(Step step)
+{
+  std::array<gf2_matrix<W>, N> table;
+  table[0] = gf2_matrix<W>::from_step(step);
+  for (std::size_t k = 1; k < N; ++k) { table[k] = table[k-1]*table[k-1]; }
+  return table;
+}
+
+/**
+ * length of the shortest linear feedback shift register over GF(2) that generates
+ * sequence, by Berlekamp-Massey. c must have sequence.size() + 1 entries and
+ * receives the connection polynomial, c[0] being the constant term.
+ */
+template<typename Sequence, typename Polynomial>
+constexpr int berlekamp_massey(Sequence const& sequence, Polynomial& c)
+{
+  int const n = static_cast<int>(sequence.size());
+  std::fill(c.begin(), c.end(), false);
+  c[0] = true;
+  Polynomial b = c;
+  Polynomial previous = c;
+  int length = 0;
+  int m = 1;
+  for (int i = 0; i < n; ++i) {
+    unsigned discrepancy = sequence[i];
+    for (int j = 1; j <= length; ++j) { discrepancy ^= c[j] & sequence[i-j]; }
+    if ((discrepancy & 1u) == 0) { ++m; continue; }
+    previous = c;
+    for (int j = 0; j + m <= n; ++j) { c[j+m] ^= b[j]; }
+    if (2*length <= i) {
+      length = i + 1 - length;
+      b = previous;
+      m = 1;
+    }
+    else { ++m; }
+  }
+  return length;
+}
+
+/**
+ * true if the linear map step on W-bit words has the maximal period 2^W-1. The
+ * characteristic polynomial is recovered with Berlekamp-Massey from one bit of the
+ * state sequence and tested for primitivity: x^(2^W-1) = 1 and x^((2^W-1)/q) != 1
+ * modulo the polynomial for every prime factor q of 2^W-1.
+ */
+template<std::unsigned_integral W, typename Step>
+constexpr bool gf2_full_period(Step step)
+{
+  constexpr int bits = std::numeric_limits<W>::digits;
+  std::array<uint64_t, 7> factors{};
+  if constexpr (bits == 8) { factors = {3, 5, 17}; }
+  else if constexpr (bits == 16) { factors = {3, 5, 17, 257}; }
+  else if constexpr (bits == 32) { factors = {3, 5, 17, 257, 65537}; }
+  else if constexpr (bits == 64) { factors = {3, 5, 17, 257, 641, 65537, 6700417}; }
+  else { return false; }
+
+  // Berlekamp-Massey on 2W bits of the lowest state bit
+  constexpr int n = 2*bits;
+  std::array<bool, n> sequence{};
+  W x = 1;
+  for (bool& bit : sequence) {
+    x = step(x);
+    bit = x & 1u;
+  }
+  std::array<bool, n + 1> c{};
+  int const length = berlekamp_massey(sequence, c);
+  if (length != bits) { return false; }
+
+  // the characteristic polynomial x^W + c1 x^(W-1) + ... + cW without its leading term
+  W poly = 0;
+  for (int j = 1; j <= bits; ++j) { if (c[j]) { poly |= W{1} << (bits - j); } }
+  auto mulmod = [poly](W lhs, W rhs) {
+    W result = 0;
+    for (int i = bits - 1; i >= 0; --i) {
+      bool const carry = (result >> (bits - 1)) & 1u;
+      result = static_cast<W>(result << 1);
+      if (carry) { result ^= poly; }
+      if ((rhs >> i) & 1u) { result ^= lhs; }
+    }
+    return result;
+  };
+  auto x_power = [&mulmod](uint64_t e) {
+    W result = 1;
+    W base = 2;
+    for (; e != 0; e >>= 1) {
+      if (e & 1u) { result = mulmod(result, base); }
+      base = mulmod(base, base);
+    }
+    return result;
+  };
+  uint64_t const period = std::numeric_limits<W>::max();
+  if (x_power(period) != 1) { return false; }
+  for (uint64_t q : factors) {
+    if (q != 0 and x_power(period / q) == 1) { return false; }
+  }
+  return true;
+}
+
+/**
+ * cursors over the binary engine states. Words are stored little-endian whatever
+ * the host, so checkpoints move between machines; the byte loops compile to plain
+ * loads and stores on little-endian targets.
+ */
+class state_writer
+{
+  std::byte* out_;
+public:
+  constexpr explicit state_writer(std::byte* out): out_(out) { }
+  template<std::unsigned_integral UInt>
+  constexpr state_writer& operator<<(UInt v)
+  {
+    for (std::size_t i = 0; i < sizeof(UInt); ++i) { *out_++ = static_cast<std::byte>(v >> (8*i)); }
+    return *this;
+  }
+};
+
+class state_reader
+{
+  std::byte const* in_;
+public:
+  constexpr explicit state_reader(std::byte const* in): in_(in) { }
+  template<std::unsigned_integral UInt>
+  constexpr state_reader& operator>>(UInt& v)
+  {
+    v = 0;
+    for (std::size_t i = 0; i < sizeof(UInt); ++i) { v |= static_cast<UInt>(std::to_integer<UInt>(*in_++) << (8*i)); }
+    return *this;
+  }
+};
+}
+
+/** order of the three shifts of a xorshift step. */
+enum class xorshift_order { left_right_left, right_left_right };
+
+namespace detail {
+template<std::unsigned_integral UInt, int a, int b, int c, xorshift_order Order>
+constexpr UInt xorshift_step(UInt x)
+{
+  if constexpr (Order == xorshift_order::left_right_left) {
+    x ^= x << a;
+    x ^= x >> b;
+    x ^= x << c;
+  }
+  else {
+    x ^= x >> a;
+    x ^= x << b;
+    x ^= x >> c;
+  }
+  return x;
+}
+}
+
+/**
+ * Marsaglia's one word xorshift generators, "Xorshift RNGs" (2003). The shift
+ * triple is checked at compile time: the template only instantiates if the
+ * transition matrix has the full period 2^W-1. A Multiplier other than 1 turns the
+ * engine into Vigna's xorshift* variant, which multiplies the state on output.
+ * Everything is constexpr, so sequences and tables can be computed at compile time.
+ * source https://en.wikipedia.org/wiki/Xorshift
+ */
+template<std::unsigned_integral UInt, int a, int b, int c,
+         xorshift_order Order=xorshift_order::left_right_left, UInt Multiplier=1>
+class xorshift_engine
+{
+  static constexpr int bits = std::numeric_limits<UInt>::digits;
+  static_assert(0 < a and a < bits and 0 < b and b < bits and 0 < c and c < bits, "shifts must be smaller than the word size");
+
+  UInt seed_;
+
+  static constexpr UInt period = std::numeric_limits<UInt>::max();
+  static_assert(detail::gf2_full_period<UInt>(detail::xorshift_step<UInt, a, b, c, Order>),
+                "the shift triple does not give the full period 2^W-1");
+public:
+  typedef UInt result_type;
+
+  constexpr xorshift_engine(): seed_(12) { }
+
+  constexpr explicit xorshift_engine(UInt seed_): seed_(seed_) { }
+
+  /** one step of the state recursion, without the output multiplication. */
+  static constexpr UInt step(UInt x) { return detail::xorshift_step<UInt, a, b, c, Order>(x); }
+
+  /** the powers step^(2^k), built once on first use at runtime. */
+  static std::array<detail::gf2_matrix<UInt>, bits> const& jump_table()
+  {
+    static auto const table = detail::gf2_power_table_at_runtime<UInt, bits>(step);
+    return table;
+  }
+
+  /** x advanced by z steps, z < 2^bits, using the powers step^(2^k) in table. */
+  static constexpr UInt jump(std::array<detail::gf2_matrix<UInt>, bits> const& table, UInt x, unsigned long long z)
+  {
+    for (std::size_t k = 0; z != 0; ++k, z >>= 1) {
+      if (z & 1u) { x = table[k](x); }
+    }
+    return x;
+  }
+
+  /* The state word must be initialized to non-zero */
+  constexpr UInt operator()()
+  {
+    seed_ = step(seed_);
+    return seed_*Multiplier;
+  }
+
+  /**
+   * advances the state by z steps in O(log z) by applying the precomputed powers of
+   * the transition matrix. Distances are taken modulo the period 2^W-1.
+   */
+  constexpr void discard(unsigned long long z)
+  {
+    if constexpr (bits < 64) { z %= period; }
+    if (std::is_constant_evaluated()) {
+      // the same powers as the runtime table, squared as they are needed. Building the
+      // whole table here would be folded by the compiler in every translation unit.
+      auto power = detail::gf2_matrix<UInt>::from_step(step);
+      for (; z != 0; z >>= 1) {
+        if (z & 1u) { seed_ = power(seed_); }
+        power = power*power;
+      }
+      return;
+    }
+    seed_ = jump(jump_table(), seed_, z);
+  }
+  constexpr static UInt min() { return std::numeric_limits<UInt>::min(); }
+  constexpr static UInt max() { return std::numeric_limits<UInt>::max(); }
+
+  constexpr void seed(){*this = xorshift_engine();}
+  constexpr void seed(UInt seed_inp){*this = xorshift_engine(seed_inp);}
+
+  [[nodiscard]] constexpr UInt state() const { return seed_; }
+
+  /**
+   * binary state, a fixed number of little-endian bytes. Much faster than the
+   * stream operators when checkpointing many engines.
+   * @returns false, leaving the engine or the bytes untouched, if the span is shorter than state_bytes().
+   */
+  constexpr static std::size_t state_bytes() { return sizeof(UInt); }
+  constexpr bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer(out.data()) << seed_;
+    return true;
+  }
+  constexpr bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader(in.data()) >> seed_;
+    return true;
+  }
+
+  constexpr bool operator==(xorshift_engine const& rhs) const{
+    return seed_==rhs.seed_;
+  }
+  constexpr bool operator!=(xorshift_engine const& rhs) const{
+    return seed_!=rhs.seed_;
+  }
+
+
+  friend auto operator<<( std::ostream& os, xorshift_engine const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    os << rng.seed_;
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, xorshift_engine & rng) -> std::istream & {
+    is.flags(std::istream::dec | std::istream::skipws);
+    is >> rng.seed_;
+    return is;
+  }
+
+};
+
+using xorshift32 = xorshift_engine<uint32_t, 13, 17, 5>;
+using xorshift64 = xorshift_engine<uint64_t, 13, 7, 17>;
+using xorshift64star = xorshift_engine<uint64_t, 12, 25, 27, xorshift_order::right_left_right, 0x2545F4914F6CDD1Dull>;
+
+
+/**
+ * SplitMix64 by Sebastiano Vigna. Mainly used to expand a single seed into the
+ * state of the larger engines, but it is a fast generator in its own right.
+ * source https://prng.di.unimi.it/splitmix64.c
+ */
+class splitmix64
+{
+  uint64_t state_;
+  static constexpr uint64_t gamma = 0x9e3779b97f4a7c15ull;
+public:
+  typedef uint64_t result_type;
+  static constexpr result_type default_seed = 5489u;
+
+  constexpr splitmix64(): state_(default_seed) { }
+  constexpr explicit splitmix64(result_type seed_): state_(seed_) { }
+
+  constexpr result_type operator()()
+  {
+    uint64_t z = (state_ += gamma);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+  }
+  /** the state is a Weyl sequence, so discarding is a single multiply-add. */
+  constexpr void discard(unsigned long long z) { state_ += gamma*z; }
+
+  constexpr static result_type min() { return std::numeric_limits<result_type>::min(); }
+  constexpr static result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  constexpr void seed(){*this = splitmix64();}
+  constexpr void seed(result_type seed_inp){*this = splitmix64(seed_inp);}
+
+  constexpr static std::size_t state_bytes() { return sizeof(state_); }
+  constexpr bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer(out.data()) << state_;
+    return true;
+  }
+  constexpr bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader(in.data()) >> state_;
+    return true;
+  }
+
+  constexpr bool operator==(splitmix64 const& rhs) const { return state_==rhs.state_; }
+  constexpr bool operator!=(splitmix64 const& rhs) const { return state_!=rhs.state_; }
+
+  friend auto operator<<(std::ostream& os, splitmix64 const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    os << rng.state_;
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, splitmix64& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    is >> rng.state_;
+    return is;
+  }
+};
+
+
+/**
+ * Vigna's xorshift128+ with the shift triple as template parameters. The 128-bit
+ * transition matrix is too large to check in a constant expression, so the triple
+ * has to be one of the full period triples published by Vigna. Seeding from a
+ * single value goes through splitmix64.
+ * source https://arxiv.org/abs/1404.0390
+ */
+template<int a=23, int b=18, int c=5>
+class xorshift128plus_engine
+{
+  static_assert((a == 23 and b == 18 and c == 5) or (a == 23 and b == 17 and c == 26),
+                "not a known full period xorshift128+ triple");
+  std::array<uint64_t, 2> s_;
+public:
+  typedef uint64_t result_type;
+  static constexpr result_type default_seed = 5489u;
+
+  constexpr xorshift128plus_engine() { seed(); }
+  constexpr explicit xorshift128plus_engine(result_type seed_) { seed(seed_); }
+  /** the state must not be all zero. */
+  constexpr explicit xorshift128plus_engine(std::array<uint64_t, 2> const& state): s_(state) { }
+
+  constexpr result_type operator()()
+  {
+    uint64_t s1 = s_[0];
+    uint64_t const s0 = s_[1];
+    s_[0] = s0;
+    s1 ^= s1 << a;
+    s_[1] = s1 ^ s0 ^ (s1 >> b) ^ (s0 >> c);
+    return s_[1] + s0;
+  }
+
+  constexpr void discard(unsigned long long z)
+  {
+    for (unsigned long long i = 0; i < z; ++i) { (*this)(); }
+  }
+
+  constexpr static result_type min() { return std::numeric_limits<result_type>::min(); }
+  constexpr static result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  constexpr void seed() { seed(default_seed); }
+  constexpr void seed(result_type seed_inp)
+  {
+    splitmix64 sm(seed_inp);
+    s_ = {sm(), sm()};
+  }
+
+  [[nodiscard]] constexpr std::array<uint64_t, 2> const& state() const { return s_; }
+
+  constexpr static std::size_t state_bytes() { return sizeof(s_); }
+  constexpr bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer writer(out.data());
+    for (auto word : s_) { writer << word; }
+    return true;
+  }
+  constexpr bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader reader(in.data());
+    for (auto& word : s_) { reader >> word; }
+    return true;
+  }
+
+  constexpr bool operator==(xorshift128plus_engine const& rhs) const { return s_==rhs.s_; }
+  constexpr bool operator!=(xorshift128plus_engine const& rhs) const { return s_!=rhs.s_; }
+
+  friend auto operator<<(std::ostream& os, xorshift128plus_engine const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    os << rng.s_[0] << ' ' << rng.s_[1];
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, xorshift128plus_engine& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    is >> rng.s_[0] >> rng.s_[1];
+    return is;
+  }
+};
+
+using xorshift128plus = xorshift128plus_engine<>;
+
+enum class xoshiro_scrambler { plus, plusplus, starstar };
+
+/**
+ * xoshiro generators by Blackman and Vigna with four words of state: xoshiro256
+ * for 64-bit words and xoshiro128 for 32-bit words. The scrambler selects the
+ * output function. Seeding from a single value goes through splitmix64, as the
+ * authors recommend. jump() and long_jump() advance the state by 2^(W*2) and
+ * 2^(W*3) steps and are meant for handing out non-overlapping parallel streams.
+ * source https://prng.di.unimi.it/
+ */
+template<std::unsigned_integral UInt, xoshiro_scrambler Scrambler>
+requires (std::same_as<UInt, uint32_t> or std::same_as<UInt, uint64_t>)
+class xoshiro_engine
+{
+  static constexpr bool wide = std::same_as<UInt, uint64_t>;
+  static constexpr int shift = wide ? 17 : 9;
+  static constexpr int rotation = wide ? 45 : 11;
+  std::array<UInt, 4> s_;
+
+  constexpr void jump_with(std::array<UInt, 4> const& polynomial)
+  {
+    std::array<UInt, 4> acc{};
+    for (UInt word : polynomial) {
+      for (int b = 0; b < std::numeric_limits<UInt>::digits; ++b) {
+        if (word & (UInt{1} << b)) {
+          for (std::size_t i = 0; i < 4; ++i) { acc[i] ^= s_[i]; }
+        }
+        (*this)();
+      }
+    }
+    s_ = acc;
+  }
+
+public:
+  typedef UInt result_type;
+  static constexpr uint64_t default_seed = 5489u;
+
+  constexpr xoshiro_engine() { seed(); }
+  constexpr explicit xoshiro_engine(result_type seed_) { seed(seed_); }
+  /** the state must not be all zero. */
+  constexpr explicit xoshiro_engine(std::array<UInt, 4> const& state): s_(state) { }
+
+  constexpr result_type operator()()
+  {
+    UInt result;
+    if constexpr (Scrambler == xoshiro_scrambler::plus) {
+      result = s_[0] + s_[3];
+    }
+    else if constexpr (Scrambler == xoshiro_scrambler::plusplus) {
+      result = std::rotl(UInt(s_[0] + s_[3]), wide ? 23 : 7) + s_[0];
+    }
+    else {
+      result = std::rotl(UInt(s_[1]*5), 7)*9;
+    }
+    UInt const t = s_[1] << shift;
+    s_[2] ^= s_[0];
+    s_[3] ^= s_[1];
+    s_[1] ^= s_[2];
+    s_[0] ^= s_[3];
+    s_[2] ^= t;
+    s_[3] = std::rotl(s_[3], rotation);
+    return result;
+  }
+
+  constexpr void discard(unsigned long long z)
+  {
+    for (unsigned long long i = 0; i < z; ++i) { (*this)(); }
+  }
+
+  constexpr void jump()
+  {
+    if constexpr (wide) { jump_with({0x180ec6d33cfd0abaull, 0xd5a61266f0c9392cull, 0xa9582618e03fc9aaull, 0x39abdc4529b1661cull}); }
+    else { jump_with({0x8764000bu, 0xf542d2d3u, 0x6fa035c3u, 0x77f2db5bu}); }
+  }
+
+  constexpr void long_jump()
+  {
+    if constexpr (wide) { jump_with({0x76e15d3efefdcbbfull, 0xc5004e441c522fb3ull, 0x77710069854ee241ull, 0x39109bb02acbe635ull}); }
+    else { jump_with({0xb523952eu, 0x0b6f099fu, 0xccf5a0efu, 0x1c580662u}); }
+  }
+
+  constexpr static result_type min() { return std::numeric_limits<result_type>::min(); }
+  constexpr static result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  constexpr void seed() { seed(static_cast<result_type>(default_seed)); }
+  constexpr void seed(result_type seed_inp)
+  {
+    splitmix64 sm(seed_inp);
+    if constexpr (wide) {
+      for (UInt& word : s_) { word = sm(); }
+    }
+    else {
+      for (std::size_t i = 0; i < 4; i += 2) {
+        uint64_t const z = sm();
+        s_[i] = static_cast<UInt>(z);
+        s_[i+1] = static_cast<UInt>(z >> 32);
+      }
+    }
+  }
+
+  [[nodiscard]] constexpr std::array<UInt, 4> const& state() const { return s_; }
+
+  constexpr static std::size_t state_bytes() { return sizeof(s_); }
+  constexpr bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer writer(out.data());
+    for (auto word : s_) { writer << word; }
+    return true;
+  }
+  constexpr bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader reader(in.data());
+    for (auto& word : s_) { reader >> word; }
+    return true;
+  }
+
+  constexpr bool operator==(xoshiro_engine const& rhs) const { return s_==rhs.s_; }
+  constexpr bool operator!=(xoshiro_engine const& rhs) const { return s_!=rhs.s_; }
+
+  friend auto operator<<(std::ostream& os, xoshiro_engine const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    os << rng.s_[0] << ' ' << rng.s_[1] << ' ' << rng.s_[2] << ' ' << rng.s_[3];
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, xoshiro_engine& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    is >> rng.s_[0] >> rng.s_[1] >> rng.s_[2] >> rng.s_[3];
+    return is;
+  }
+};
+
+using xoshiro256starstar = xoshiro_engine<uint64_t, xoshiro_scrambler::starstar>;
+using xoshiro256plus = xoshiro_engine<uint64_t, xoshiro_scrambler::plus>;
+using xoshiro128plusplus = xoshiro_engine<uint32_t, xoshiro_scrambler::plusplus>;
+
+
+namespace detail {
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define CUTILS_HAS_AVX2_DISPATCH 1
+inline bool cpu_has_avx2()
+{
+  static bool const has = __builtin_cpu_supports("avx2");
+  return has;
+}
+
+__attribute__((target("avx2")))
+inline void xorshift32x8_blocks_avx2(uint32_t* state, uint32_t* out, std::size_t blocks)
+{
+  __m256i x = _mm256_load_si256(reinterpret_cast<__m256i const*>(state));
+  for (std::size_t b = 0; b < blocks; ++b) {
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 13));
+    x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 17));
+    x = _mm256_xor_si256(x, _mm256_slli_epi32(x, 5));
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 8*b), x);
+  }
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state), x);
+}
+
+__attribute__((target("avx2")))
+inline __m256i rotl_avx2(__m256i x, int k)
+{
+  return _mm256_or_si256(_mm256_slli_epi64(x, k), _mm256_srli_epi64(x, 64 - k));
+}
+
+__attribute__((target("avx2")))
+inline void xoshiro256x4_blocks_avx2(uint64_t (*state)[4], uint64_t* out, std::size_t blocks)
+{
+  __m256i s0 = _mm256_load_si256(reinterpret_cast<__m256i const*>(state[0]));
+  __m256i s1 = _mm256_load_si256(reinterpret_cast<__m256i const*>(state[1]));
+  __m256i s2 = _mm256_load_si256(reinterpret_cast<__m256i const*>(state[2]));
+  __m256i s3 = _mm256_load_si256(reinterpret_cast<__m256i const*>(state[3]));
+  for (std::size_t b = 0; b < blocks; ++b) {
+    // AVX2 has no 64-bit multiply, x*5 and x*9 are done with shifts and adds
+    __m256i const times5 = _mm256_add_epi64(_mm256_slli_epi64(s1, 2), s1);
+    __m256i const rotated = rotl_avx2(times5, 7);
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + 4*b), _mm256_add_epi64(_mm256_slli_epi64(rotated, 3), rotated));
+    __m256i const t = _mm256_slli_epi64(s1, 17);
+    s2 = _mm256_xor_si256(s2, s0);
+    s3 = _mm256_xor_si256(s3, s1);
+    s1 = _mm256_xor_si256(s1, s2);
+    s0 = _mm256_xor_si256(s0, s3);
+    s2 = _mm256_xor_si256(s2, t);
+    s3 = rotl_avx2(s3, 45);
+  }
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[0]), s0);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[1]), s1);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[2]), s2);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(state[3]), s3);
+}
+#endif
+
+/**
+ * common part of the multi-lane engines: a block of one output per lane is
+ * buffered, so operator() and fill() produce the same interleaved sequence
+ * lane 0, lane 1, ..., lane N-1, lane 0, ...
+ * Derived provides `generate_blocks(result_type* out, std::size_t blocks)`.
+ */
+template<typename Derived, std::unsigned_integral UInt, std::size_t Lanes>
+class multi_lane_engine
+{
+protected:
+  alignas(64) std::array<UInt, Lanes> buffer_{};
+  std::size_t next_ = Lanes;
+
+  Derived& self() { return static_cast<Derived&>(*this); }
+
+public:
+  typedef UInt result_type;
+  static constexpr std::size_t lanes = Lanes;
+
+  result_type operator()()
+  {
+    if (next_ == Lanes) {
+      self().generate_blocks(buffer_.data(), 1);
+      next_ = 0;
+    }
+    return buffer_[next_++];
+  }
+
+  /**
+   * fills out with the next out.size() numbers of the sequence. Whole blocks are
+   * generated straight into out with the widest instruction set the CPU supports.
+   */
+  void fill(std::span<result_type> out)
+  {
+    std::size_t i = 0;
+    while (next_ != Lanes and i < out.size()) { out[i++] = buffer_[next_++]; }
+    std::size_t const blocks = (out.size() - i) / Lanes;
+    if (blocks != 0) {
+      self().generate_blocks(out.data() + i, blocks);
+      i += blocks*Lanes;
+    }
+    while (i < out.size()) { out[i++] = (*this)(); }
+  }
+
+  constexpr static result_type min() { return std::numeric_limits<result_type>::min(); }
+  constexpr static result_type max() { return std::numeric_limits<result_type>::max(); }
+};
+}
+
+/**
+ * eight interleaved xorshift32 generators. Lane i starts i/8 of the period further
+ * down the sequence of xorshift32(seed), so the lanes do not overlap.
+ */
+class xorshift32x8 : public detail::multi_lane_engine<xorshift32x8, uint32_t, 8>
+{
+  friend class detail::multi_lane_engine<xorshift32x8, uint32_t, 8>;
+  alignas(32) std::array<uint32_t, 8> s_{};
+
+  void generate_blocks(uint32_t* out, std::size_t blocks)
+  {
+#ifdef CUTILS_HAS_AVX2_DISPATCH
+    if (detail::cpu_has_avx2()) {
+      detail::xorshift32x8_blocks_avx2(s_.data(), out, blocks);
+      return;
+    }
+#endif
+    for (std::size_t b = 0; b < blocks; ++b) {
+      for (std::size_t l = 0; l < lanes; ++l) { out[lanes*b + l] = s_[l] = xorshift32::step(s_[l]); }
+    }
+  }
+
+public:
+  xorshift32x8() { seed(); }
+  explicit xorshift32x8(result_type seed_) { seed(seed_); }
+
+  void seed() { seed(xorshift32().state()); }
+  void seed(result_type seed_inp)
+  {
+    xorshift32 lane(seed_inp);
+    for (std::size_t l = 0; l < lanes; ++l) {
+      s_[l] = lane.state();
+      lane.discard(0xFFFF'FFFFull / lanes);
+    }
+    next_ = lanes;
+  }
+
+  void discard(unsigned long long z)
+  {
+    for (; z != 0 and next_ != lanes; --z) { ++next_; }
+    for (uint32_t& state : s_) {
+      xorshift32 lane(state);
+      lane.discard(z / lanes);
+      state = lane.state();
+    }
+    for (z %= lanes; z != 0; --z) { (*this)(); }
+  }
+
+  /** the lane states, the read position and the buffered outputs. */
+  constexpr static std::size_t state_bytes() { return (2*lanes + 1)*sizeof(result_type); }
+  bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer writer(out.data());
+    for (uint32_t state : s_) { writer << state; }
+    writer << static_cast<result_type>(next_);
+    for (uint32_t buffered : buffer_) { writer << buffered; }
+    return true;
+  }
+  bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader reader(in.data());
+    for (uint32_t& state : s_) { reader >> state; }
+    result_type next;
+    reader >> next;
+    next_ = std::min<std::size_t>(next, lanes);
+    for (uint32_t& buffered : buffer_) { reader >> buffered; }
+    return true;
+  }
+
+  bool operator==(xorshift32x8 const& rhs) const
+  {
+    return s_ == rhs.s_ and next_ == rhs.next_ and
+           std::equal(buffer_.begin() + static_cast<std::ptrdiff_t>(next_), buffer_.end(), rhs.buffer_.begin() + static_cast<std::ptrdiff_t>(next_));
+  }
+  bool operator!=(xorshift32x8 const& rhs) const { return not (*this == rhs); }
+
+  friend auto operator<<(std::ostream& os, xorshift32x8 const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    for (uint32_t state : rng.s_) { os << state << ' '; }
+    os << rng.next_;
+    for (uint32_t buffered : rng.buffer_) { os << ' ' << buffered; }
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, xorshift32x8& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    for (uint32_t& state : rng.s_) { is >> state; }
+    is >> rng.next_;
+    for (uint32_t& buffered : rng.buffer_) { is >> buffered; }
+    return is;
+  }
+};
+
+/**
+ * four interleaved xoshiro256** generators. Lane i is the stream of
+ * xoshiro256starstar(seed) after i calls to jump().
+ */
+class xoshiro256x4 : public detail::multi_lane_engine<xoshiro256x4, uint64_t, 4>
+{
+  friend class detail::multi_lane_engine<xoshiro256x4, uint64_t, 4>;
+  // s_[w][l] is word w of the state of lane l
+  alignas(32) uint64_t s_[4][4]{};
+
+  void generate_blocks(uint64_t* out, std::size_t blocks)
+  {
+#ifdef CUTILS_HAS_AVX2_DISPATCH
+    if (detail::cpu_has_avx2()) {
+      detail::xoshiro256x4_blocks_avx2(s_, out, blocks);
+      return;
+    }
+#endif
+    for (std::size_t b = 0; b < blocks; ++b) {
+      for (std::size_t l = 0; l < lanes; ++l) {
+        xoshiro256starstar lane({s_[0][l], s_[1][l], s_[2][l], s_[3][l]});
+        out[lanes*b + l] = lane();
+        for (std::size_t w = 0; w < 4; ++w) { s_[w][l] = lane.state()[w]; }
+      }
+    }
+  }
+
+  void set_lane(std::size_t l, xoshiro256starstar const& lane)
+  {
+    for (std::size_t w = 0; w < 4; ++w) { s_[w][l] = lane.state()[w]; }
+  }
+
+public:
+  xoshiro256x4() { seed(); }
+  explicit xoshiro256x4(result_type seed_) { seed(seed_); }
+
+  void seed() { seed(xoshiro256starstar::default_seed); }
+  void seed(result_type seed_inp)
+  {
+    xoshiro256starstar lane(seed_inp);
+    for (std::size_t l = 0; l < lanes; ++l) {
+      set_lane(l, lane);
+      lane.jump();
+    }
+    next_ = lanes;
+  }
+
+  void discard(unsigned long long z)
+  {
+    for (; z != 0 and next_ != lanes; --z) { ++next_; }
+    for (std::size_t l = 0; l < lanes; ++l) {
+      xoshiro256starstar lane({s_[0][l], s_[1][l], s_[2][l], s_[3][l]});
+      lane.discard(z / lanes);
+      set_lane(l, lane);
+    }
+    for (z %= lanes; z != 0; --z) { (*this)(); }
+  }
+
+  /** advances every lane by 2^128 steps. */
+  void jump()
+  {
+    for (std::size_t l = 0; l < lanes; ++l) {
+      xoshiro256starstar lane({s_[0][l], s_[1][l], s_[2][l], s_[3][l]});
+      lane.jump();
+      set_lane(l, lane);
+    }
+    next_ = lanes;
+  }
+
+  /** the lane states, the read position and the buffered outputs. */
+  constexpr static std::size_t state_bytes() { return (4*lanes + 1 + lanes)*sizeof(result_type); }
+  bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer writer(out.data());
+    for (auto const& word : s_) { for (uint64_t state : word) { writer << state; } }
+    writer << static_cast<result_type>(next_);
+    for (uint64_t buffered : buffer_) { writer << buffered; }
+    return true;
+  }
+  bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader reader(in.data());
+    for (auto& word : s_) { for (uint64_t& state : word) { reader >> state; } }
+    result_type next;
+    reader >> next;
+    next_ = std::min<std::size_t>(next, lanes);
+    for (uint64_t& buffered : buffer_) { reader >> buffered; }
+    return true;
+  }
+
+  bool operator==(xoshiro256x4 const& rhs) const
+  {
+    return std::equal(&s_[0][0], &s_[0][0] + 16, &rhs.s_[0][0]) and next_ == rhs.next_ and
+           std::equal(buffer_.begin() + static_cast<std::ptrdiff_t>(next_), buffer_.end(), rhs.buffer_.begin() + static_cast<std::ptrdiff_t>(next_));
+  }
+  bool operator!=(xoshiro256x4 const& rhs) const { return not (*this == rhs); }
+
+  friend auto operator<<(std::ostream& os, xoshiro256x4 const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    for (auto const& word : rng.s_) { for (uint64_t state : word) { os << state << ' '; } }
+    os << rng.next_;
+    for (uint64_t buffered : rng.buffer_) { os << ' ' << buffered; }
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, xoshiro256x4& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    for (auto& word : rng.s_) { for (uint64_t& state : word) { is >> state; } }
+    is >> rng.next_;
+    for (uint64_t& buffered : rng.buffer_) { is >> buffered; }
+    return is;
+  }
+};
+
+
+namespace detail {
+/**
+ * common part of the counter-based engines. The n-th number of a stream is word
+ * n%N of bijection(block n/N, key), so any position can be reached in O(1) and
+ * the numbers do not depend on how the work is split between threads.
+ * Derived provides `key(seed, stream)`, `block(counter, key)` and `batch(counter, key, out)`,
+ * which writes the batch_blocks blocks starting at counter.
+ */
+template<typename Derived, std::unsigned_integral UInt, std::size_t N>
+class counter_based_engine
+{
+public:
+  typedef UInt result_type;
+  using block_type = std::array<UInt, N>;
+  static constexpr std::size_t block_size = N;
+
+protected:
+  uint64_t seed_ = 0;
+  uint64_t stream_ = 0;
+  uint64_t position_ = 0;
+  block_type buffer_{};
+  uint64_t buffered_block_ = std::numeric_limits<uint64_t>::max();
+
+  constexpr counter_based_engine(uint64_t seed_inp, uint64_t stream): seed_(seed_inp), stream_(stream) { }
+
+public:
+  constexpr result_type operator()()
+  {
+    uint64_t const block = position_ / N;
+    if (block != buffered_block_) {
+      buffer_ = Derived::block(block, Derived::key(seed_, stream_));
+      buffered_block_ = block;
+    }
+    return buffer_[position_++ % N];
+  }
+
+  /** the number at position n of the stream, without changing the engine. */
+  [[nodiscard]] constexpr result_type operator[](uint64_t n) const
+  {
+    return Derived::block(n / N, Derived::key(seed_, stream_))[n % N];
+  }
+
+  constexpr void discard(unsigned long long z) { position_ += z; }
+  [[nodiscard]] constexpr uint64_t position() const { return position_; }
+  constexpr void set_position(uint64_t n) { position_ = n; }
+  [[nodiscard]] constexpr uint64_t stream() const { return stream_; }
+
+  /**
+   * writes the numbers at positions [first, first + out.size()) of the stream.
+   * Blocks are computed lane-parallel in fixed batches so that the compiler can
+   * vectorize the rounds.
+   */
+  void generate(uint64_t first, std::span<result_type> out) const
+  {
+    auto const key = Derived::key(seed_, stream_);
+    std::size_t i = 0;
+    for (; i < out.size() and (first + i) % N != 0; ++i) { out[i] = (*this)[first + i]; }
+    constexpr std::size_t batch = Derived::batch_blocks;
+    uint64_t block = (first + i) / N;
+    while (out.size() - i >= batch*N) {
+      Derived::batch(block, key, out.data() + i);
+      block += batch;
+      i += batch*N;
+    }
+    for (; out.size() - i >= N; i += N, ++block) {
+      block_type const b = Derived::block(block, key);
+      std::copy(b.begin(), b.end(), out.begin() + static_cast<std::ptrdiff_t>(i));
+    }
+    for (; i < out.size(); ++i) { out[i] = (*this)[first + i]; }
+  }
+
+  /** generate() starting at the current position, which is advanced past the output. */
+  void fill(std::span<result_type> out)
+  {
+    generate(position_, out);
+    position_ += out.size();
+  }
+
+  constexpr static result_type min() { return std::numeric_limits<result_type>::min(); }
+  constexpr static result_type max() { return std::numeric_limits<result_type>::max(); }
+
+  constexpr void seed() { seed(0); }
+  constexpr void seed(uint64_t seed_inp, uint64_t stream=0)
+  {
+    seed_ = seed_inp;
+    stream_ = stream;
+    position_ = 0;
+    buffered_block_ = std::numeric_limits<uint64_t>::max();
+  }
+
+  /** seed, stream and position; the buffered block is recomputed on demand. */
+  constexpr static std::size_t state_bytes() { return 3*sizeof(uint64_t); }
+  constexpr bool save(std::span<std::byte> out) const
+  {
+    if (out.size() < state_bytes()) { return false; }
+    detail::state_writer(out.data()) << seed_ << stream_ << position_;
+    return true;
+  }
+  constexpr bool load(std::span<std::byte const> in)
+  {
+    if (in.size() < state_bytes()) { return false; }
+    detail::state_reader(in.data()) >> seed_ >> stream_ >> position_;
+    buffered_block_ = std::numeric_limits<uint64_t>::max();
+    return true;
+  }
+
+  constexpr bool operator==(counter_based_engine const& rhs) const
+  {
+    return seed_ == rhs.seed_ and stream_ == rhs.stream_ and position_ == rhs.position_;
+  }
+  constexpr bool operator!=(counter_based_engine const& rhs) const { return not (*this == rhs); }
+
+  friend auto operator<<(std::ostream& os, Derived const& rng) -> std::ostream& {
+    os.flags(std::ostream::dec | std::ostream::skipws);
+    os << rng.seed_ << ' ' << rng.stream_ << ' ' << rng.position_;
+    return os;
+  }
+
+  friend auto operator>>(std::istream& is, Derived& rng) -> std::istream& {
+    is.flags(std::istream::dec | std::istream::skipws);
+    is >> rng.seed_ >> rng.stream_ >> rng.position_;
+    rng.buffered_block_ = std::numeric_limits<uint64_t>::max();
+    return is;
+  }
+};
+}
+
+/**
+ * Philox4x32-10 counter-based generator by Salmon et al., "Parallel random numbers:
+ * as easy as 1, 2, 3". The 64-bit seed is the key; the 128-bit counter holds the
+ * block index in its low and the stream id in its high half.
+ */
+class philox4x32 : public detail::counter_based_engine<philox4x32, uint32_t, 4>
+{
+  using base = detail::counter_based_engine<philox4x32, uint32_t, 4>;
+  static constexpr uint32_t multiplier0 = 0xD2511F53u;
+  static constexpr uint32_t multiplier1 = 0xCD9E8D57u;
+  static constexpr uint32_t weyl0 = 0x9E3779B9u;
+  static constexpr uint32_t weyl1 = 0xBB67AE85u;
+
+public:
+  using counter_type = std::array<uint32_t, 4>;
+  struct key_type {
+    std::array<uint32_t, 2> words;
+    uint64_t stream;
+  };
+  static constexpr std::size_t batch_blocks = 16;
+
+  constexpr philox4x32(): base(0, 0) { }
+  constexpr explicit philox4x32(result_type seed_inp): base(seed_inp, 0) { }
+  constexpr philox4x32(uint64_t seed_inp, uint64_t stream): base(seed_inp, stream) { }
+
+  /** the raw bijection, ten rounds on one counter. */
+  static constexpr block_type bijection(counter_type c, std::array<uint32_t, 2> k)
+  {
+    for (int round = 0; round < 10; ++round) {
+      if (round != 0) {
+        k[0] += weyl0;
+        k[1] += weyl1;
+      }
+      uint64_t const p0 = uint64_t{multiplier0} * c[0];
+      uint64_t const p1 = uint64_t{multiplier1} * c[2];
+      c = {static_cast<uint32_t>(p1 >> 32) ^ c[1] ^ k[0], static_cast<uint32_t>(p1),
+           static_cast<uint32_t>(p0 >> 32) ^ c[3] ^ k[1], static_cast<uint32_t>(p0)};
+    }
+    return c;
+  }
+
+  static constexpr key_type key(uint64_t seed_inp, uint64_t stream)
+  {
+    return {{static_cast<uint32_t>(seed_inp), static_cast<uint32_t>(seed_inp >> 32)}, stream};
+  }
+
+  static constexpr block_type block(uint64_t counter, key_type const& k)
+  {
+    return bijection({static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32),
+                      static_cast<uint32_t>(k.stream), static_cast<uint32_t>(k.stream >> 32)}, k.words);
+  }
+
+  static void batch(uint64_t counter, key_type const& k, uint32_t* out)
+  {
+    constexpr std::size_t L = batch_blocks;
+    uint32_t c0[L], c1[L], c2[L], c3[L];
+    for (std::size_t l = 0; l < L; ++l) {
+      c0[l] = static_cast<uint32_t>(counter + l);
+      c1[l] = static_cast<uint32_t>((counter + l) >> 32);
+      c2[l] = static_cast<uint32_t>(k.stream);
+      c3[l] = static_cast<uint32_t>(k.stream >> 32);
+    }
+    uint32_t k0 = k.words[0];
+    uint32_t k1 = k.words[1];
+    for (int round = 0; round < 10; ++round) {
+      for (std::size_t l = 0; l < L; ++l) {
+        uint64_t const p0 = uint64_t{multiplier0} * c0[l];
+        uint64_t const p1 = uint64_t{multiplier1} * c2[l];
+        c0[l] = static_cast<uint32_t>(p1 >> 32) ^ c1[l] ^ k0;
+        c1[l] = static_cast<uint32_t>(p1);
+        c2[l] = static_cast<uint32_t>(p0 >> 32) ^ c3[l] ^ k1;
+        c3[l] = static_cast<uint32_t>(p0);
+      }
+      k0 += weyl0;
+      k1 += weyl1;
+    }
+    for (std::size_t l = 0; l < L; ++l) {
+      out[4*l] = c0[l];
+      out[4*l + 1] = c1[l];
+      out[4*l + 2] = c2[l];
+      out[4*l + 3] = c3[l];
+    }
+  }
+};
+
+/**
+ * Threefry2x64-20 counter-based generator from the same paper, built on the
+ * Threefish block cipher. The key is (seed, stream id), the counter is the block index.
+ */
+class threefry2x64 : public detail::counter_based_engine<threefry2x64, uint64_t, 2>
+{
+  using base = detail::counter_based_engine<threefry2x64, uint64_t, 2>;
+  static constexpr uint64_t parity = 0x1BD11BDAA9FC1A22ull;
+  static constexpr int rotations[8] = {16, 42, 12, 31, 16, 32, 24, 21};
+
+public:
+  using counter_type = std::array<uint64_t, 2>;
+  /** the two key words followed by their parity word. */
+  using key_type = std::array<uint64_t, 3>;
+  static constexpr std::size_t batch_blocks = 16;
+
+  constexpr threefry2x64(): base(0, 0) { }
+  constexpr explicit threefry2x64(result_type seed_inp): base(seed_inp, 0) { }
+  constexpr threefry2x64(uint64_t seed_inp, uint64_t stream): base(seed_inp, stream) { }
+
+  static constexpr key_type key(uint64_t seed_inp, uint64_t stream)
+  {
+    return {seed_inp, stream, parity ^ seed_inp ^ stream};
+  }
+
+  /** the raw bijection, twenty rounds on one counter. */
+  static constexpr block_type bijection(counter_type c, key_type const& ks)
+  {
+    uint64_t x0 = c[0] + ks[0];
+    uint64_t x1 = c[1] + ks[1];
+    for (int round = 0; round < 20; ++round) {
+      x0 += x1;
+      x1 = std::rotl(x1, rotations[round % 8]);
+      x1 ^= x0;
+      if (round % 4 == 3) {
+        uint64_t const s = static_cast<uint64_t>(round / 4 + 1);
+        x0 += ks[s % 3];
+        x1 += ks[(s + 1) % 3] + s;
+      }
+    }
+    return {x0, x1};
+  }
+
+  static constexpr block_type block(uint64_t counter, key_type const& ks) { return bijection({counter, 0}, ks); }
+
+  static void batch(uint64_t counter, key_type const& ks, uint64_t* out)
+  {
+    constexpr std::size_t L = batch_blocks;
+    uint64_t x0[L], x1[L];
+    for (std::size_t l = 0; l < L; ++l) {
+      x0[l] = counter + l + ks[0];
+      x1[l] = ks[1];
+    }
+    for (int round = 0; round < 20; ++round) {
+      int const r = rotations[round % 8];
+      for (std::size_t l = 0; l < L; ++l) {
+        x0[l] += x1[l];
+        x1[l] = std::rotl(x1[l], r);
+        x1[l] ^= x0[l];
+      }
+      if (round % 4 == 3) {
+        uint64_t const s = static_cast<uint64_t>(round / 4 + 1);
+        for (std::size_t l = 0; l < L; ++l) {
+          x0[l] += ks[s % 3];
+          x1[l] += ks[(s + 1) % 3] + s;
+        }
+      }
+    }
+    for (std::size_t l = 0; l < L; ++l) {
+      out[2*l] = x0[l];
+      out[2*l + 1] = x1[l];
+    }
+  }
+};
+
+
+namespace detail {
+/**
+ * number of random bits a generator delivers per call, or 0 if its range is not a
+ * power of two.
+ */
+template<typename G>
+constexpr int generator_bits()
+{
+  using R = typename G::result_type;
+  R const range = G::max() - G::min();
+  if (range == std::numeric_limits<R>::max()) { return std::numeric_limits<R>::digits; }
+  return std::has_single_bit(static_cast<R>(range + 1)) ? std::countr_zero(static_cast<R>(range + 1)) : 0;
+}
+
+/**
+ * a uniformly distributed W-bit word drawn from g. Wider draws are truncated to
+ * their high bits, narrower draws are concatenated, first draw in the high half.
+ */
+template<std::unsigned_integral W, typename G>
+constexpr W draw_word(G& g)
+{
+  constexpr int bits = generator_bits<G>();
+  constexpr int word_bits = std::numeric_limits<W>::digits;
+  static_assert(bits >= 32, "the generator must deliver at least 32 random bits per call");
+  if constexpr (bits >= word_bits) {
+    return static_cast<W>(static_cast<uint64_t>(g() - G::min()) >> (bits - word_bits));
+  }
+  else {
+    uint64_t const hi = static_cast<uint64_t>(g() - G::min()) >> (bits - 32);
+    uint64_t const lo = static_cast<uint64_t>(g() - G::min()) >> (bits - 32);
+    return static_cast<W>((hi << 32) | lo);
+  }
+}
+
+template<typename G, std::unsigned_integral W>
+constexpr std::size_t draws_per_word = generator_bits<G>() >= std::numeric_limits<W>::digits ? 1 : 2;
+
+#if defined(__SIZEOF_INT128__)
+// __extension__ keeps -Wpedantic quiet about the non-standard type
+__extension__ typedef unsigned __int128 uint128;
+#endif
+
+constexpr uint64_t mul_hi_lo(uint64_t a, uint64_t b, uint64_t& lo)
+{
+#if defined(__SIZEOF_INT128__)
+  uint128 const p = static_cast<uint128>(a) * b;
+  lo = static_cast<uint64_t>(p);
+  return static_cast<uint64_t>(p >> 64);
+#else
+  uint64_t const a_lo = a & 0xFFFF'FFFFu, a_hi = a >> 32;
+  uint64_t const b_lo = b & 0xFFFF'FFFFu, b_hi = b >> 32;
+  uint64_t const ll = a_lo*b_lo, lh = a_lo*b_hi, hl = a_hi*b_lo, hh = a_hi*b_hi;
+  uint64_t const mid = (ll >> 32) + (lh & 0xFFFF'FFFFu) + (hl & 0xFFFF'FFFFu);
+  lo = (mid << 32) | (ll & 0xFFFF'FFFFu);
+  return hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+#endif
+}
+
+inline void prefetch([[maybe_unused]] void const* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p);
+#endif
+}
+
+inline void prefetch_for_write([[maybe_unused]] void const* p)
+{
+#if defined(__GNUC__) || defined(__clang__)
+  __builtin_prefetch(p, 1);
+#endif
+}
+
+/**
+ * hands out the results of g from a buffer that is filled in bulk, with g.fill()
+ * if the generator has one. It is never filled with more draws than requested, and
+ * reads past the buffer go to g directly, so the sequence of draws is exactly the
+ * one the scalar code would have made.
+ */
+template<typename G, std::size_t Chunk=256>
+class buffered_draws
+{
+  G& g_;
+  std::array<typename G::result_type, Chunk> buffer_;
+  std::size_t pos_ = 0;
+  std::size_t size_ = 0;
+public:
+  typedef typename G::result_type result_type;
+  explicit buffered_draws(G& g): g_(g) { }
+
+  constexpr static result_type min() { return G::min(); }
+  constexpr static result_type max() { return G::max(); }
+
+  void refill(std::size_t n)
+  {
+    size_ = std::min(n, Chunk);
+    pos_ = 0;
+    if constexpr (requires { g_.fill(std::span<result_type>(buffer_.data(), size_)); }) {
+      g_.fill(std::span<result_type>(buffer_.data(), size_));
+    }
+    else {
+      for (std::size_t i = 0; i < size_; ++i) { buffer_[i] = g_(); }
+    }
+  }
+  [[nodiscard]] bool empty() const { return pos_ == size_; }
+  result_type operator()() { return pos_ != size_ ? buffer_[pos_++] : g_(); }
+};
+
+/**
+ * fills out with convert(draws) for every element, pulling the draws in chunks.
+ * draws_per_element is the least number of draws one element consumes.
+ */
+template<typename G, typename T, typename Convert>
+void fill_batched(G& g, std::span<T> out, std::size_t draws_per_element, Convert convert)
+{
+  buffered_draws<G> draws(g);
+  std::size_t i = 0;
+  while (i < out.size()) {
+    draws.refill((out.size() - i)*draws_per_element);
+    while (i < out.size() and not draws.empty()) { out[i++] = convert(draws); }
+  }
+}
+}
+
+/**
+ * uniform integer in [0, range) with Lemire's nearly divisionless method
+ * ("Fast Random Integer Generation in an Interval", 2019).
+ */
+template<UniformRandomBitGenerator G>
+constexpr uint32_t bounded_u32(G& g, uint32_t range)
+{
+  uint64_t m = uint64_t{detail::draw_word<uint32_t>(g)} * range;
+  auto low = static_cast<uint32_t>(m);
+  if (low < range) {
+    uint32_t const threshold = static_cast<uint32_t>(-range) % range;
+    while (low < threshold) {
+      m = uint64_t{detail::draw_word<uint32_t>(g)} * range;
+      low = static_cast<uint32_t>(m);
+    }
+  }
+  return static_cast<uint32_t>(m >> 32);
+}
+
+/** 64-bit version of bounded_u32. */
+template<UniformRandomBitGenerator G>
+constexpr uint64_t bounded_u64(G& g, uint64_t range)
+{
+  uint64_t low;
+  uint64_t high = detail::mul_hi_lo(detail::draw_word<uint64_t>(g), range, low);
+  if (low < range) {
+    uint64_t const threshold = (0 - range) % range;
+    while (low < threshold) { high = detail::mul_hi_lo(detail::draw_word<uint64_t>(g), range, low); }
+  }
+  return high;
+}
+
+/**
+ * uniform floating point number in [0, 1) made from the top 53 (double) or 24
+ * (float) bits of one draw, i.e. every representable multiple of 2^-53 or 2^-24
+ * is equally likely. The result is the same on every platform.
+ */
+template<std::floating_point T, UniformRandomBitGenerator G>
+constexpr T canonical(G& g)
+{
+  if constexpr (std::same_as<T, float>) {
+    return static_cast<float>(detail::draw_word<uint32_t>(g) >> 8) * 0x1p-24f;
+  }
+  else {
+    return static_cast<T>(static_cast<double>(detail::draw_word<uint64_t>(g) >> 11) * 0x1p-53);
+  }
+}
+
+/**
+ * replacement for std::uniform_int_distribution on [a, b] that gives the same
+ * numbers with every standard library.
+ */
+template<std::integral T>
+class uniform_int_distribution
+{
+  using U = std::make_unsigned_t<T>;
+  T a_;
+  T b_;
+
+  [[nodiscard]] constexpr U range() const { return static_cast<U>(static_cast<U>(b_) - static_cast<U>(a_)); }
+
+  template<typename G>
+  constexpr T sample(G& g) const
+  {
+    U const r = range();
+    if constexpr (sizeof(U) <= sizeof(uint32_t)) {
+      if (r == std::numeric_limits<U>::max()) { return static_cast<T>(detail::draw_word<uint32_t>(g)); }
+      return static_cast<T>(static_cast<U>(a_) + static_cast<U>(bounded_u32(g, static_cast<uint32_t>(r) + 1)));
+    }
+    else {
+      if (r == std::numeric_limits<U>::max()) { return static_cast<T>(detail::draw_word<uint64_t>(g)); }
+      if (r < std::numeric_limits<uint32_t>::max()) {
+        return static_cast<T>(static_cast<U>(a_) + bounded_u32(g, static_cast<uint32_t>(r) + 1));
+      }
+      return static_cast<T>(static_cast<U>(a_) + bounded_u64(g, static_cast<uint64_t>(r) + 1));
+    }
+  }
+
+public:
+  typedef T result_type;
+
+  constexpr explicit uniform_int_distribution(T a=0, T b=std::numeric_limits<T>::max()): a_(a), b_(b) { }
+
+  [[nodiscard]] constexpr T a() const { return a_; }
+  [[nodiscard]] constexpr T b() const { return b_; }
+
+  template<UniformRandomBitGenerator G>
+  constexpr T operator()(G& g) const { return sample(g); }
+
+  /** the same numbers as calling operator() out.size() times, with bulk draws from g. */
+  template<UniformRandomBitGenerator G>
+  void fill(G& g, std::span<T> out) const
+  {
+    bool const wide = sizeof(U) > sizeof(uint32_t) and range() >= std::numeric_limits<uint32_t>::max();
+    std::size_t const per_element = wide ? detail::draws_per_word<G, uint64_t> : 1;
+    detail::fill_batched(g, out, per_element, [this](auto& draws) { return sample(draws); });
+  }
+};
+
+/**
+ * replacement for std::uniform_real_distribution on [a, b) based on canonical().
+ */
+template<std::floating_point T>
+class uniform_real_distribution
+{
+  T a_;
+  T b_;
+
+  template<typename G>
+  constexpr T sample(G& g) const
+  {
+    T const x = a_ + (b_ - a_)*canonical<T>(g);
+    // rounding can hit b for some intervals
+    return x < b_ ? x : a_;
+  }
+
+public:
+  typedef T result_type;
+
+  constexpr explicit uniform_real_distribution(T a=0, T b=1): a_(a), b_(b) { }
+
+  [[nodiscard]] constexpr T a() const { return a_; }
+  [[nodiscard]] constexpr T b() const { return b_; }
+
+  template<UniformRandomBitGenerator G>
+  constexpr T operator()(G& g) const { return sample(g); }
+
+  /** the same numbers as calling operator() out.size() times, with bulk draws from g. */
+  template<UniformRandomBitGenerator G>
+  void fill(G& g, std::span<T> out) const
+  {
+    std::size_t const per_element = std::same_as<T, float> ? 1 : detail::draws_per_word<G, uint64_t>;
+    detail::fill_batched(g, out, per_element, [this](auto& draws) { return sample(draws); });
+  }
+};
+
+namespace detail {
+/**
+ * layer boundaries x and densities f of a 256 layer ziggurat, following Marsaglia
+ * and Tsang, "The Ziggurat Method for Generating Random Variables" (2000).
+ * x[0] is the width of the base strip including the tail, x[1] = r, x[256] = 0.
+ */
+struct ziggurat_table {
+  std::array<double, 257> x;
+  std::array<double, 257> f;
+
+  template<typename Density, typename Inverse>
+  ziggurat_table(double r, double v, Density density, Inverse inverse)
+  {
+    x[0] = v / density(r);
+    x[1] = r;
+    for (std::size_t i = 1; i < 255; ++i) { x[i+1] = inverse(v / x[i] + density(x[i])); }
+    x[256] = 0;
+    for (std::size_t i = 0; i < 257; ++i) { f[i] = density(x[i]); }
+  }
+};
+
+inline double normal_density(double x) { return std::exp(-0.5*x*x); }
+inline double exponential_density(double x) { return std::exp(-x); }
+
+inline ziggurat_table const& normal_ziggurat()
+{
+  static ziggurat_table const table(3.6541528853610088, 0.00492867323399, normal_density,
+                                    [](double y) { return std::sqrt(-2.0*std::log(y)); });
+  return table;
+}
+
+inline ziggurat_table const& exponential_ziggurat()
+{
+  static ziggurat_table const table(7.697117470131487, 0.0039496598225815571993, exponential_density,
+                                    [](double y) { return -std::log(y); });
+  return table;
+}
+
+/**
+ * one ziggurat draw. The low 8 bits of a 64-bit word select the layer and the top
+ * 53 bits the position in it, so about 99% of the draws cost one word, one table
+ * lookup and one comparison.
+ */
+template<bool Symmetric, typename G, typename Density, typename Tail>
+double ziggurat(G& g, ziggurat_table const& t, Density density, Tail tail)
+{
+  while (true) {
+    uint64_t const bits = draw_word<uint64_t>(g);
+    std::size_t const i = bits & 0xFFu;
+    double u = static_cast<double>(bits >> 11) * 0x1p-53;
+    if constexpr (Symmetric) { u = 2.0*u - 1.0; }
+    double const x = u * t.x[i];
+    if (std::abs(x) < t.x[i+1]) { return x; }
+    if (i == 0) { return tail(g, u); }
+    if (t.f[i+1] + (t.f[i] - t.f[i+1])*canonical<double>(g) < density(x)) { return x; }
+  }
+}
+
+template<typename G>
+double standard_normal(G& g)
+{
+  return ziggurat<true>(g, normal_ziggurat(), normal_density, [](G& gen, double u) {
+    constexpr double r = 3.6541528853610088;
+    double x;
+    double y;
+    do {
+      // 1 - canonical lies in (0, 1], so the logarithms are finite
+      x = std::log(1.0 - canonical<double>(gen)) / r;
+      y = std::log(1.0 - canonical<double>(gen));
+    } while (-2.0*y < x*x);
+    return u < 0 ? x - r : r - x;
+  });
+}
+
+template<typename G>
+double standard_exponential(G& g)
+{
+  return ziggurat<false>(g, exponential_ziggurat(), exponential_density, [](G& gen, double) {
+    return 7.697117470131487 - std::log(1.0 - canonical<double>(gen));
+  });
+}
+}
+
+/**
+ * normal distribution sampled with a 256 layer ziggurat. It gives the same numbers
+ * with every standard library, up to the last bit of std::exp and std::log in the
+ * rare slow path.
+ */
+template<std::floating_point T=double>
+class normal_distribution
+{
+  T mean_;
+  T stddev_;
+public:
+  typedef T result_type;
+
+  constexpr explicit normal_distribution(T mean=0, T stddev=1): mean_(mean), stddev_(stddev) { }
+
+  [[nodiscard]] constexpr T mean() const { return mean_; }
+  [[nodiscard]] constexpr T stddev() const { return stddev_; }
+
+  template<UniformRandomBitGenerator G>
+  T operator()(G& g) const { return mean_ + stddev_*static_cast<T>(detail::standard_normal(g)); }
+
+  /**
+   * the same numbers as calling operator() out.size() times. The random bits are
+   * drawn in bulk, through the SIMD fill() of the multi-lane engines where available.
+   */
+  template<UniformRandomBitGenerator G>
+  void fill(G& g, std::span<T> out) const
+  {
+    detail::fill_batched(g, out, detail::draws_per_word<G, uint64_t>,
+                         [this](auto& draws) { return mean_ + stddev_*static_cast<T>(detail::standard_normal(draws)); });
+  }
+};
 
-  friend auto operator<<( std::ostream& os, xorshift32 const& rng) -> std::ostream& {
-    os.flags(std::ostream::dec | std::ostream::skipws);
-    os << rng.seed_;
-    return os;
+/**
+ * exponential distribution with rate lambda sampled with a 256 layer ziggurat.
+ */
+template<std::floating_point T=double>
+class exponential_distribution
+{
+  T lambda_;
+public:
+  typedef T result_type;
+
+  constexpr explicit exponential_distribution(T lambda=1): lambda_(lambda) { }
+
+  [[nodiscard]] constexpr T lambda() const { return lambda_; }
+
+  template<UniformRandomBitGenerator G>
+  T operator()(G& g) const { return static_cast<T>(detail::standard_exponential(g)) / lambda_; }
+
+  /** the same numbers as calling operator() out.size() times, with bulk draws from g. */
+  template<UniformRandomBitGenerator G>
+  void fill(G& g, std::span<T> out) const
+  {
+    detail::fill_batched(g, out, detail::draws_per_word<G, uint64_t>,
+                         [this](auto& draws) { return static_cast<T>(detail::standard_exponential(draws)) / lambda_; });
   }
+};
 
-  friend auto operator>>(std::istream& is, xorshift32 & rng) -> std::istream & {
-    is.flags(std::istream::dec | std::istream::skipws);
-    is >> rng.seed_;
-    return is;
+/**
+ * replacement for std::discrete_distribution with Walker's alias method, built in
+ * O(n) with Vose's algorithm ("A Linear Algorithm for Generating Random Numbers with
+ * a Given Distribution", 1991). Every sample costs one 64-bit draw and two table
+ * reads. The tables are kept as separate arrays of 32-bit thresholds and aliases,
+ * 8 bytes per weight, and support up to 2^32 - 1 weights.
+ *
+ * Weights that cannot form a distribution (none, more than 2^32 - 1, a negative,
+ * infinite or NaN weight, or a zero sum) give an empty distribution: valid() is false,
+ * size() is 0 and a message goes to std::cerr. Like a default constructed one it must
+ * not be sampled, which is checked with assert.
+ */
+template<std::integral T=int>
+class discrete_distribution
+{
+  std::vector<uint32_t> threshold_;
+  std::vector<uint32_t> alias_;
+
+  /** bucket index from the high part of g*n, the coin from the low part. */
+  [[nodiscard]] T lookup(uint64_t word) const
+  {
+    uint64_t coin;
+    auto const i = static_cast<uint32_t>(detail::mul_hi_lo(word, threshold_.size(), coin));
+    // both reads happen unconditionally so that the choice compiles to a conditional move
+    uint32_t const alias = alias_[i];
+    return static_cast<T>(static_cast<uint32_t>(coin >> 32) < threshold_[i] ? i : alias);
+  }
+public:
+  typedef T result_type;
+
+  discrete_distribution() = default;
+
+  /** weights need not be normalized; they must be finite, non-negative and not all zero. */
+  explicit discrete_distribution(std::span<double const> weights)
+  {
+    std::size_t const n = weights.size();
+    double sum = 0;
+    bool finite = true;
+    for (double w : weights) {
+      // written so that NaN fails too
+      finite = finite and w >= 0 and w <= std::numeric_limits<double>::max();
+      sum += w;
+    }
+    if (n == 0 or n > std::numeric_limits<uint32_t>::max() or not finite or
+        not (sum > 0 and sum <= std::numeric_limits<double>::max())) {
+      std::cerr << "discrete_distribution: needs between 1 and 2^32 - 1 finite, non-negative weights with a positive sum\n";
+      return;
+    }
+    threshold_.resize(n);
+    alias_.resize(n);
+    // scaled probabilities, n times the normalized weight; buckets below 1 take an alias.
+    // Instead of work lists, two cursors sweep the array for unpaired small and large
+    // buckets, and a large bucket that drops below 1 is paired right away.
+    std::vector<double> scaled(n);
+    double const scale = static_cast<double>(n) / sum;
+    for (std::size_t i = 0; i < n; ++i) { scaled[i] = weights[i] * scale; }
+    constexpr uint32_t unpaired = std::numeric_limits<uint32_t>::max();
+    std::fill(alias_.begin(), alias_.end(), unpaired);
+    auto next_small = [&](std::size_t i) {
+      while (i < n and (scaled[i] >= 1.0 or alias_[i] != unpaired)) { ++i; }
+      return i;
+    };
+    auto next_large = [&](std::size_t i) {
+      while (i < n and scaled[i] < 1.0) { ++i; }
+      return i;
+    };
+    std::size_t cursor = next_small(0);
+    std::size_t small = cursor;
+    std::size_t large = next_large(0);
+    while (small < n and large < n) {
+      threshold_[small] = static_cast<uint32_t>(scaled[small] * 0x1p32);
+      alias_[small] = static_cast<uint32_t>(large);
+      scaled[large] -= 1.0 - scaled[small];
+      if (scaled[large] < 1.0) {
+        small = large;
+        large = next_large(large + 1);
+      }
+      else {
+        cursor = next_small(cursor + 1);
+        small = cursor;
+      }
+    }
+    // whatever is left is full up to rounding; a self alias makes the threshold irrelevant
+    for (std::size_t i = 0; i < n; ++i) {
+      if (alias_[i] == unpaired) {
+        threshold_[i] = unpaired;
+        alias_[i] = static_cast<uint32_t>(i);
+      }
+    }
+  }
+
+  discrete_distribution(std::initializer_list<double> weights)
+    : discrete_distribution(std::span<double const>(weights.begin(), weights.size())) { }
+
+  /** false if the distribution was default constructed or built from invalid weights. */
+  [[nodiscard]] bool valid() const { return not threshold_.empty(); }
+
+  [[nodiscard]] std::size_t size() const { return threshold_.size(); }
+
+  /** the probabilities the tables actually sample with. */
+  [[nodiscard]] std::vector<double> probabilities() const
+  {
+    std::vector<double> p(size());
+    double const bucket = 1.0 / static_cast<double>(size());
+    for (std::size_t i = 0; i < size(); ++i) {
+      double const keep = alias_[i] == i ? 1.0 : threshold_[i] * 0x1p-32;
+      p[i] += keep * bucket;
+      p[alias_[i]] += (1.0 - keep) * bucket;
+    }
+    return p;
+  }
+
+  template<UniformRandomBitGenerator G>
+  T operator()(G& g) const
+  {
+    assert(valid());
+    return lookup(detail::draw_word<uint64_t>(g));
+  }
+
+  /** the same numbers as calling operator() out.size() times, with bulk draws from g. */
+  template<UniformRandomBitGenerator G>
+  void fill(G& g, std::span<T> out) const
+  {
+    assert(valid());
+    detail::fill_batched(g, out, detail::draws_per_word<G, uint64_t>,
+                         [this](auto& draws) { return lookup(detail::draw_word<uint64_t>(draws)); });
+  }
+};
+
+/**
+ * hands out per-thread engines that are derived from one master seed, so that a
+ * parallel run can be reproduced from the seed and the thread indices alone.
+ *
+ * The engine of thread index i is, in order of preference, stream i of a
+ * counter-based engine, the master engine advanced by i calls to jump(), or an
+ * engine seeded with the i-th output of splitmix64(master seed).
+ *
+ * local() returns the calling thread's engine from a cache line aligned
+ * thread_local slot and takes no lock. A thread that did not call bind() gets the
+ * next free index the first time it asks. Every thread keeps one slot per pool it
+ * used, so a thread can switch between pools and continue each stream where it
+ * left it. The slots live as long as the thread.
+ */
+template<RandomNumberEngine Engine>
+class RngPool
+{
+  struct alignas(64) Slot {
+    std::size_t index = 0;
+    Engine engine;
+  };
+
+  struct ThreadSlots {
+    uint64_t last_pool_id = 0;
+    Slot* last = nullptr;
+    // node based, so a Slot does not move when other pools are added
+    std::unordered_map<uint64_t, Slot> by_pool;
+  };
+
+  static inline std::atomic<uint64_t> next_pool_id_{1};
+  uint64_t master_seed_;
+  uint64_t id_ = next_pool_id_.fetch_add(1, std::memory_order_relaxed);
+  std::atomic<std::size_t> next_index_{0};
+
+  static ThreadSlots& thread_slots()
+  {
+    thread_local ThreadSlots slots;
+    return slots;
+  }
+
+  /** the calling thread's slot of this pool, nullptr if it has none yet. */
+  Slot* find_slot() const
+  {
+    ThreadSlots& slots = thread_slots();
+    if (slots.last_pool_id == id_) { return slots.last; }
+    auto const it = slots.by_pool.find(id_);
+    if (it == slots.by_pool.end()) { return nullptr; }
+    slots.last_pool_id = id_;
+    slots.last = &it->second;
+    return slots.last;
+  }
+
+public:
+  explicit RngPool(uint64_t master_seed): master_seed_(master_seed) { }
+
+  RngPool(RngPool const&) = delete;
+  RngPool& operator=(RngPool const&) = delete;
+
+  [[nodiscard]] uint64_t master_seed() const { return master_seed_; }
+
+  /** the engine of the given thread index, the same for every run with this master seed. */
+  [[nodiscard]] Engine engine(std::size_t thread_index) const
+  {
+    if constexpr (std::constructible_from<Engine, uint64_t, uint64_t>) {
+      return Engine(master_seed_, static_cast<uint64_t>(thread_index));
+    }
+    else if constexpr (requires(Engine e) { e.jump(); }) {
+      Engine e(static_cast<typename Engine::result_type>(master_seed_));
+      for (std::size_t i = 0; i < thread_index; ++i) { e.jump(); }
+      return e;
+    }
+    else {
+      splitmix64 seeds(master_seed_);
+      seeds.discard(thread_index);
+      auto seed_value = static_cast<typename Engine::result_type>(seeds());
+      // xorshift style engines must not start from zero
+      if (seed_value == 0) { seed_value = 1; }
+      return Engine(seed_value);
+    }
+  }
+
+  /**
+   * binds the calling thread to thread_index and returns its engine. Binding the index
+   * the thread already has keeps the engine where it is, another index starts that
+   * index's stream from the beginning.
+   */
+  Engine& bind(std::size_t thread_index)
+  {
+    Slot* s = find_slot();
+    if (s != nullptr and s->index == thread_index) { return s->engine; }
+    if (s == nullptr) {
+      ThreadSlots& slots = thread_slots();
+      s = &slots.by_pool.try_emplace(id_, Slot{thread_index, engine(thread_index)}).first->second;
+      slots.last_pool_id = id_;
+      slots.last = s;
+      return s->engine;
+    }
+    s->index = thread_index;
+    s->engine = engine(thread_index);
+    return s->engine;
+  }
+
+  /** the calling thread's engine. */
+  Engine& local()
+  {
+    if (Slot* s = find_slot()) { return s->engine; }
+    return bind(next_index_.fetch_add(1, std::memory_order_relaxed));
+  }
+
+  /** the thread index the calling thread's engine was derived from. */
+  std::size_t local_index()
+  {
+    local();
+    return find_slot()->index;
+  }
+};
+
+/**
+ * true for engines whose discard(z) costs O(log z) or less, which is what makes it
+ * worthwhile to start a worker in the middle of the sequence.
+ */
+template<typename E>
+constexpr bool has_fast_discard = false;
+template<std::unsigned_integral UInt, int a, int b, int c, xorshift_order Order, UInt Multiplier>
+constexpr bool has_fast_discard<xorshift_engine<UInt, a, b, c, Order, Multiplier>> = true;
+template<> constexpr bool has_fast_discard<splitmix64> = true;
+template<> constexpr bool has_fast_discard<xorshift32x8> = true;
+template<> constexpr bool has_fast_discard<philox4x32> = true;
+template<> constexpr bool has_fast_discard<threefry2x64> = true;
+
+template<typename E>
+concept JumpAheadEngine = RandomNumberEngine<E> && has_fast_discard<E>;
+
+/**
+ * fills out with the next out.size() numbers of engine, in parallel. Every thread
+ * takes a copy of the engine and jumps to the start of its chunk with discard(),
+ * so the result is bit for bit what engine.fill(out) or a loop of engine() would
+ * give, whatever the thread count. The engine is advanced by out.size().
+ * @param threads number of threads, 0 for std::thread::hardware_concurrency().
+ */
+template<JumpAheadEngine E>
+void parallel_fill(E& engine, std::span<typename E::result_type> out, unsigned threads=0)
+{
+  using T = typename E::result_type;
+  // chunks are whole pages, and at least 256 KiB so that the discard and the thread start are amortized
+  constexpr std::size_t page = 4096 / sizeof(T);
+  constexpr std::size_t min_chunk = (1u << 18) / sizeof(T);
+  auto fill_chunk = [](E& e, std::span<T> chunk) {
+    if constexpr (requires { e.fill(chunk); }) { e.fill(chunk); }
+    else { for (T& v : chunk) { v = e(); } }
+  };
+
+  if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+  std::size_t const n = out.size();
+  std::size_t chunk = (n + threads - 1) / threads;
+  chunk = std::max(min_chunk, (chunk + page - 1) / page * page);
+  std::size_t const chunks = (n + chunk - 1) / chunk;
+  if (chunks <= 1) {
+    fill_chunk(engine, out);
+    return;
+  }
+
+  std::vector<std::jthread> workers;
+  workers.reserve(chunks - 1);
+  for (std::size_t c = 1; c < chunks; ++c) {
+    workers.emplace_back([&, c] {
+      E local = engine;
+      local.discard(c*chunk);
+      fill_chunk(local, out.subspan(c*chunk, std::min(chunk, n - c*chunk)));
+    });
+  }
+  E first = engine;
+  fill_chunk(first, out.first(chunk));
+  workers.clear();
+  engine.discard(n);
+}
+
+namespace detail {
+/** uniform double in the open interval (0, 1). */
+template<typename G>
+double open_unit(G& g)
+{
+  return (static_cast<double>(draw_word<uint64_t>(g) >> 11) + 0.5) * 0x1p-53;
+}
+}
+
+/**
+ * Fisher-Yates shuffle of [first, last). While the bounds allow it, one 64-bit draw
+ * yields two swap indices (Brackett-Rozinsky and Lemire, "Batched Ranged Random
+ * Integer Generation", 2024). The indices of a block of positions are computed
+ * first and their elements prefetched before swapping, so the cache misses of a
+ * large array overlap instead of being paid one after another.
+ */
+template<std::random_access_iterator It, UniformRandomBitGenerator G>
+void shuffle(It first, It last, G& g)
+{
+  constexpr std::size_t block = 32;
+  auto n = static_cast<uint64_t>(last - first);
+  std::array<uint64_t, block> targets;
+  while (n > 1) {
+    std::size_t const count = static_cast<std::size_t>(std::min<uint64_t>(block, n - 1));
+    // position n-1-t swaps with targets[t], a uniform index in [0, n-t)
+    std::size_t t = 0;
+    for (; t + 1 < count and (n - t) <= (uint64_t{1} << 32); t += 2) {
+      uint64_t const bound1 = n - t;
+      uint64_t const bound2 = n - t - 1;
+      uint64_t const product = bound1*bound2;
+      uint64_t lo;
+      uint64_t first_index;
+      uint64_t second_index;
+      while (true) {
+        first_index = detail::mul_hi_lo(detail::draw_word<uint64_t>(g), bound1, lo);
+        second_index = detail::mul_hi_lo(lo, bound2, lo);
+        if (lo >= product or lo >= (0 - product) % product) { break; }
+      }
+      targets[t] = first_index;
+      targets[t+1] = second_index;
+    }
+    for (; t < count; ++t) { targets[t] = bounded_u64(g, n - t); }
+    for (t = 0; t < count; ++t) { detail::prefetch_for_write(&*(first + static_cast<std::ptrdiff_t>(targets[t]))); }
+    for (t = 0; t < count; ++t) {
+      using std::swap;
+      swap(*(first + static_cast<std::ptrdiff_t>(n - 1 - t)), *(first + static_cast<std::ptrdiff_t>(targets[t])));
+    }
+    n -= count;
+  }
+}
+
+/**
+ * uniform sample of k elements of [first, last) written to out, with Li's
+ * Algorithm L ("Reservoir-Sampling Algorithms of Time Complexity O(n(1+log(N/n)))",
+ * 1994). Only O(k log(n/k)) random numbers are drawn; with random access iterators
+ * the skipped elements are not even visited. The sample is in no particular order.
+ * @returns the end of the written sample, which is shorter than k if the input is.
+ */
+template<std::input_iterator It, std::random_access_iterator Out, UniformRandomBitGenerator G>
+Out reservoir_sample(It first, It last, Out out, std::size_t k, G& g)
+{
+  std::size_t filled = 0;
+  for (; filled < k and first != last; ++first, ++filled) { out[static_cast<std::ptrdiff_t>(filled)] = *first; }
+  if (filled < k or k == 0) { return out + static_cast<std::ptrdiff_t>(filled); }
+
+  double const inverse_k = 1.0 / static_cast<double>(k);
+  double w = std::exp(std::log(detail::open_unit(g)) * inverse_k);
+  while (true) {
+    double const skip = std::floor(std::log(detail::open_unit(g)) / std::log1p(-w));
+    if constexpr (std::random_access_iterator<It>) {
+      if (skip >= static_cast<double>(last - first)) { break; }
+      first += static_cast<std::ptrdiff_t>(skip);
+    }
+    else {
+      for (double i = 0; i < skip and first != last; ++i) { ++first; }
+      if (first == last) { break; }
+    }
+    out[static_cast<std::ptrdiff_t>(bounded_u64(g, k))] = *first;
+    ++first;
+    w *= std::exp(std::log(detail::open_unit(g)) * inverse_k);
+  }
+  return out + static_cast<std::ptrdiff_t>(k);
+}
+
+/**
+ * k distinct indices from [0, n), uniformly chosen, in increasing order. Uses
+ * Vitter's Method D ("An Efficient Algorithm for Sequential Random Sampling",
+ * 1987), which needs O(k) time and random numbers independent of n, and falls
+ * back to Method A once k is a large fraction of what is left.
+ */
+template<UniformRandomBitGenerator G>
+std::vector<uint64_t> sample_indices(uint64_t n, uint64_t k, G& g)
+{
+  std::vector<uint64_t> result;
+  k = std::min(k, n);
+  result.reserve(k);
+  if (k == 0) { return result; }
+  uint64_t current = 0;
+  bool started = false;
+  auto emit = [&](uint64_t skip) {
+    current = started ? current + skip + 1 : skip;
+    started = true;
+    result.push_back(current);
+  };
+
+  // Method A: sequential search of the skip length
+  auto method_a = [&](uint64_t samples, uint64_t population) {
+    double top = static_cast<double>(population - samples);
+    double population_real = static_cast<double>(population);
+    while (samples >= 2) {
+      double const v = detail::open_unit(g);
+      uint64_t skip = 0;
+      double quotient = top / population_real;
+      while (quotient > v) {
+        ++skip;
+        top -= 1.0;
+        population_real -= 1.0;
+        quotient = quotient*top / population_real;
+      }
+      emit(skip);
+      population_real -= 1.0;
+      --samples;
+    }
+    emit(static_cast<uint64_t>(std::floor(std::round(population_real) * detail::open_unit(g))));
+  };
+
+  constexpr int64_t alpha_inverse = 13;
+  uint64_t samples = k;
+  uint64_t population = n;
+  double samples_inverse = 1.0 / static_cast<double>(samples);
+  double v_prime = std::exp(std::log(detail::open_unit(g)) * samples_inverse);
+  uint64_t qu1 = population - samples + 1;
+  double qu1_real = static_cast<double>(qu1);
+  uint64_t threshold = alpha_inverse*samples;
+  while (samples > 1 and threshold < population) {
+    double const samples_minus_one_inverse = 1.0 / static_cast<double>(samples - 1);
+    double const population_real = static_cast<double>(population);
+    uint64_t skip;
+    while (true) {
+      double x;
+      while (true) {
+        x = population_real * (1.0 - v_prime);
+        skip = static_cast<uint64_t>(x);
+        if (skip < qu1) { break; }
+        v_prime = std::exp(std::log(detail::open_unit(g)) * samples_inverse);
+      }
+      double const u = detail::open_unit(g);
+      double const negative_skip = -static_cast<double>(skip);
+      double const y1 = std::exp(std::log(u * population_real / qu1_real) * samples_minus_one_inverse);
+      v_prime = y1 * (1.0 - x / population_real) * (qu1_real / (negative_skip + qu1_real));
+      if (v_prime <= 1.0) { break; }
+
+      double y2 = 1.0;
+      double top = population_real - 1.0;
+      double bottom;
+      uint64_t limit;
+      if (samples - 1 > skip) {
+        bottom = static_cast<double>(population - samples);
+        limit = population - skip;
+      }
+      else {
+        bottom = population_real - 1.0 + negative_skip;
+        limit = qu1;
+      }
+      for (uint64_t t = population - 1; t >= limit; --t) {
+        y2 = y2*top / bottom;
+        top -= 1.0;
+        bottom -= 1.0;
+      }
+      if (population_real / (population_real - x) >= y1 * std::exp(std::log(y2) * samples_minus_one_inverse)) {
+        v_prime = std::exp(std::log(detail::open_unit(g)) * samples_minus_one_inverse);
+        break;
+      }
+      v_prime = std::exp(std::log(detail::open_unit(g)) * samples_inverse);
+    }
+    emit(skip);
+    population -= skip + 1;
+    --samples;
+    samples_inverse = samples_minus_one_inverse;
+    qu1 -= skip;
+    qu1_real = static_cast<double>(qu1);
+    threshold -= alpha_inverse;
+  }
+  if (samples > 1) { method_a(samples, population); }
+  else { emit(static_cast<uint64_t>(static_cast<double>(population) * v_prime)); }
+  return result;
+}
+
+/**
+ * k distinct indices from [0, n), uniformly chosen, with Floyd's algorithm. It
+ * draws exactly k random numbers and is the better choice when k is small
+ * compared to n and the order does not matter. The indices are not sorted.
+ */
+template<UniformRandomBitGenerator G>
+std::vector<uint64_t> sample_indices_unordered(uint64_t n, uint64_t k, G& g)
+{
+  k = std::min(k, n);
+  std::vector<uint64_t> result;
+  result.reserve(k);
+  std::unordered_set<uint64_t> chosen;
+  chosen.reserve(2*k);
+  for (uint64_t j = n - k; j < n; ++j) {
+    uint64_t const t = bounded_u64(g, j + 1);
+    uint64_t const pick = chosen.insert(t).second ? t : j;
+    if (pick == j) { chosen.insert(j); }
+    result.push_back(pick);
+  }
+  return result;
+}
+
+namespace detail {
+/** degree s, inner coefficients a and initial direction numbers m of a Sobol dimension. */
+struct sobol_polynomial {
+  unsigned s;
+  unsigned a;
+  std::array<uint32_t, 6> m;
+};
+
+/**
+ * Joe and Kuo's direction numbers for dimensions 2 to 16 (new-joe-kuo-6.21201),
+ * from "Constructing Sobol sequences with better two-dimensional projections" (2008).
+ */
+constexpr std::array<sobol_polynomial, 15> sobol_polynomials{{
+  {1, 0, {1}},
+  {2, 1, {1, 3}},
+  {3, 1, {1, 3, 1}},
+  {3, 2, {1, 1, 1}},
+  {4, 1, {1, 1, 3, 3}},
+  {4, 4, {1, 3, 5, 13}},
+  {5, 2, {1, 1, 5, 5, 17}},
+  {5, 4, {1, 1, 5, 5, 5}},
+  {5, 7, {1, 1, 7, 11, 19}},
+  {5, 11, {1, 1, 5, 1, 1}},
+  {5, 13, {1, 1, 1, 3, 11}},
+  {5, 14, {1, 3, 5, 5, 31}},
+  {6, 1, {1, 3, 3, 9, 7, 49}},
+  {6, 13, {1, 1, 1, 15, 21, 21}},
+  {6, 16, {1, 3, 1, 13, 27, 49}},
+}};
+
+/** direction numbers v[dimension][bit], scaled to 32 bits. */
+constexpr auto sobol_directions = [] {
+  std::array<std::array<uint32_t, 32>, sobol_polynomials.size() + 1> v{};
+  for (unsigned k = 0; k < 32; ++k) { v[0][k] = uint32_t{1} << (31 - k); }
+  for (std::size_t d = 1; d < v.size(); ++d) {
+    auto const& [s, a, m] = sobol_polynomials[d - 1];
+    for (unsigned k = 0; k < s; ++k) { v[d][k] = m[k] << (31 - k); }
+    for (unsigned k = s; k < 32; ++k) {
+      uint32_t x = v[d][k - s] ^ (v[d][k - s] >> s);
+      for (unsigned i = 1; i < s; ++i) {
+        if ((a >> (s - 1 - i)) & 1) { x ^= v[d][k - i]; }
+      }
+      v[d][k] = x;
+    }
+  }
+  return v;
+}();
+}
+
+/**
+ * Sobol low-discrepancy sequence in up to 16 dimensions with Joe and Kuo's
+ * direction numbers. The next point is one xor per dimension away thanks to the
+ * Gray code ordering (Antonov and Saleev), and any index can be reached in
+ * O(log index) steps, so parallel workers can each take a range of the sequence.
+ * The sequence starts with the origin at index 0 and has 2^32 points; once they
+ * are used up next() returns false.
+ */
+class sobol
+{
+  unsigned dimensions_ = 1;
+  uint64_t index_ = 0;
+  std::array<uint32_t, detail::sobol_directions.size()> x_{};
+public:
+  constexpr static unsigned max_dimensions = detail::sobol_directions.size();
+  /** number of points in the sequence, the direction numbers have 32 bits. */
+  constexpr static uint64_t size = uint64_t{1} << 32;
+
+  sobol() = default;
+  explicit sobol(unsigned dimensions, uint64_t index=0)
+    : dimensions_(std::clamp(dimensions, 1u, max_dimensions))
+  {
+    if (dimensions != dimensions_) {
+      std::cerr << "sobol: dimensions must be between 1 and " << max_dimensions << "\n";
+    }
+    if (not skip_to(index)) { std::cerr << "sobol: index must be below 2^32, starting at 0\n"; }
+  }
+
+  [[nodiscard]] unsigned dimensions() const { return dimensions_; }
+  /** index of the point the next call to next() returns. */
+  [[nodiscard]] uint64_t index() const { return index_; }
+
+  /** @returns false, leaving the sequence untouched, if index is not below size. */
+  bool skip_to(uint64_t index)
+  {
+    if (index >= size) { return false; }
+    index_ = index;
+    uint64_t const gray = index ^ (index >> 1);
+    for (unsigned d = 0; d < dimensions_; ++d) {
+      uint32_t x = 0;
+      for (uint64_t bits = gray & 0xFFFF'FFFFu; bits != 0; bits &= bits - 1) {
+        x ^= detail::sobol_directions[d][std::countr_zero(bits)];
+      }
+      x_[d] = x;
+    }
+    return true;
+  }
+  /** @returns false, leaving the sequence untouched, if it has fewer than z points left. */
+  bool discard(uint64_t z) { return z < size - index_ and skip_to(index_ + z); }
+
+  /**
+   * the current point as 32-bit fractions of the unit cube, before advancing.
+   * @returns false, writing nothing, if point is shorter than dimensions() or the points are used up.
+   */
+  template<std::size_t Extent>
+  bool next_integers(std::span<uint32_t, Extent> point)
+  {
+    if (point.size() < dimensions_ or index_ >= size) { return false; }
+    std::copy_n(x_.begin(), dimensions_, point.begin());
+    auto const& v = detail::sobol_directions;
+    unsigned const bit = static_cast<unsigned>(std::countr_one(index_)) & 31;
+    for (unsigned d = 0; d < dimensions_; ++d) { x_[d] ^= v[d][bit]; }
+    ++index_;
+    return true;
+  }
+
+  /**
+   * writes the current point to point[0, dimensions()) and advances.
+   * @returns false, writing nothing, if point is shorter than dimensions() or the points are used up.
+   */
+  template<std::floating_point T, std::size_t Extent>
+  bool next(std::span<T, Extent> point)
+  {
+    std::array<uint32_t, max_dimensions> x;
+    if (point.size() < dimensions_ or not next_integers(std::span(x))) { return false; }
+    // keep only the bits T can hold, or float would round the last points up to 1
+    constexpr int bits = std::min(std::numeric_limits<T>::digits, 32);
+    for (unsigned d = 0; d < dimensions_; ++d) {
+      point[d] = static_cast<T>(x[d] >> (32 - bits)) * (T{1} / static_cast<T>(uint64_t{1} << bits));
+    }
+    return true;
+  }
+
+  /**
+   * the next out.size() / dimensions() points, one after the other.
+   * @returns false if the points ran out first.
+   */
+  template<std::floating_point T, std::size_t Extent>
+  bool fill(std::span<T, Extent> out)
+  {
+    for (std::size_t i = 0; i + dimensions_ <= out.size(); i += dimensions_) {
+      if (not next(out.subspan(i, dimensions_))) { return false; }
+    }
+    return true;
+  }
+
+  bool operator==(sobol const& rhs) const { return dimensions_ == rhs.dimensions_ and index_ == rhs.index_; }
+};
+
+/**
+ * Halton low-discrepancy sequence in up to 32 dimensions, dimension d being the
+ * radical inverse of the index in the d-th prime base. The digits of the index are
+ * kept per base and updated incrementally, and the radical inverse is an exact
+ * integer over the largest power of the base that fits in 64 bits, so values do
+ * not drift. Beyond about 10 dimensions the plain Halton sequence shows strong
+ * correlations between neighbouring high bases; Sobol is the better choice there.
+ */
+class halton
+{
+  constexpr static std::array<uint32_t, 32> primes{2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+                                                   59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131};
+  struct base_state {
+    uint32_t base;
+    unsigned digits;                       // digits of the largest power of base that fits in 64 bits
+    double scale;                          // 1 / base^digits
+    std::array<uint64_t, 64> weight;       // base^(digits - 1 - k), the value of digit k in the inverse
+    std::array<uint8_t, 64> digit;         // digits of the index, least significant first
+    uint64_t inverse;                      // radical inverse times base^digits
+  };
+
+  unsigned dimensions_ = 1;
+  uint64_t index_ = 0;
+  std::vector<base_state> bases_;
+public:
+  constexpr static unsigned max_dimensions = primes.size();
+
+  halton(): halton(1) { }
+  explicit halton(unsigned dimensions, uint64_t index=0)
+    : dimensions_(std::clamp(dimensions, 1u, max_dimensions)), bases_(dimensions_)
+  {
+    if (dimensions != dimensions_) {
+      std::cerr << "halton: dimensions must be between 1 and " << max_dimensions << "\n";
+    }
+    for (unsigned d = 0; d < dimensions_; ++d) {
+      base_state& b = bases_[d];
+      b.base = primes[d];
+      b.digits = 0;
+      uint64_t power = 1;
+      while (power <= std::numeric_limits<uint64_t>::max() / b.base) { power *= b.base; ++b.digits; }
+      b.scale = 1.0 / static_cast<double>(power);
+      uint64_t w = 1;
+      for (unsigned k = b.digits; k-- > 0; ) { b.weight[k] = w; w *= b.base; }
+    }
+    skip_to(index);
+  }
+
+  [[nodiscard]] unsigned dimensions() const { return dimensions_; }
+  [[nodiscard]] uint64_t index() const { return index_; }
+
+  void skip_to(uint64_t index)
+  {
+    index_ = index;
+    for (base_state& b : bases_) {
+      b.inverse = 0;
+      uint64_t n = index;
+      for (unsigned k = 0; k < b.digits; ++k) {
+        b.digit[k] = static_cast<uint8_t>(n % b.base);
+        n /= b.base;
+        b.inverse += b.digit[k] * b.weight[k];
+      }
+    }
+  }
+  void discard(uint64_t z) { skip_to(index_ + z); }
+
+  /**
+   * writes the current point to point[0, dimensions()) and advances.
+   * @returns false, writing nothing, if point is shorter than dimensions().
+   */
+  template<std::floating_point T, std::size_t Extent>
+  bool next(std::span<T, Extent> point)
+  {
+    if (point.size() < dimensions_) { return false; }
+    for (unsigned d = 0; d < dimensions_; ++d) {
+      base_state& b = bases_[d];
+      point[d] = std::min(static_cast<T>(static_cast<double>(b.inverse) * b.scale), std::nextafter(T{1}, T{0}));
+      unsigned k = 0;
+      for (; k + 1 < b.digits and b.digit[k] == b.base - 1; ++k) {
+        b.digit[k] = 0;
+        b.inverse -= (b.base - 1) * b.weight[k];
+      }
+      ++b.digit[k];
+      b.inverse += b.weight[k];
+    }
+    ++index_;
+    return true;
+  }
+
+  /** the next out.size() / dimensions() points, one after the other. */
+  template<std::floating_point T, std::size_t Extent>
+  void fill(std::span<T, Extent> out)
+  {
+    for (std::size_t i = 0; i + dimensions_ <= out.size(); i += dimensions_) { next(out.subspan(i, dimensions_)); }
+  }
+
+  bool operator==(halton const& rhs) const { return dimensions_ == rhs.dimensions_ and index_ == rhs.index_; }
+};
+
+/** engines with a fixed-size binary state, see xorshift_engine::save(). */
+template<typename E>
+concept BinaryStateEngine = requires(E& e, E const& ce, std::span<std::byte> out, std::span<std::byte const> in) {
+  { E::state_bytes() } -> std::convertible_to<std::size_t>;
+  { ce.save(out) } -> std::same_as<bool>;
+  { e.load(in) } -> std::same_as<bool>;
+};
+
+#if defined(__linux__)
+namespace detail {
+/** header of an engine checkpoint file, followed by count records of state_bytes each. */
+struct EngineFileHeader {
+  static constexpr uint64_t magic_value = 0x31474E524C545543ull; // "CUTLRNG1"
+  uint64_t magic;
+  uint64_t state_bytes;
+  uint64_t count;
+  uint64_t reserved;
+};
+}
+
+/**
+ * writes the binary states of engines to path through a shared mapping of the
+ * file. Like write_openmetrics_file() the data goes to a temporary file that is
+ * synced and renamed over path, so a crash never leaves a torn checkpoint.
+ * @returns false if the file could not be written.
+ */
+template<typename E, std::size_t Extent>
+requires BinaryStateEngine<std::remove_const_t<E>>
+bool save_engines(std::string const& path, std::span<E, Extent> engines)
+{
+  using detail::EngineFileHeader;
+  std::size_t const record = std::remove_const_t<E>::state_bytes();
+  std::size_t const bytes = sizeof(EngineFileHeader) + record*engines.size();
+  std::string const tmp_path = path + ".tmp";
+  int fd = open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) { std::cerr << "save_engines: cannot create " << tmp_path << '\n'; return false; }
+  void* memory = MAP_FAILED;
+  if (ftruncate(fd, static_cast<off_t>(bytes)) == 0) {
+    memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  }
+  bool ok = memory != MAP_FAILED;
+  if (ok) {
+    auto* data = static_cast<std::byte*>(memory);
+    EngineFileHeader const header{EngineFileHeader::magic_value, record, engines.size(), 0};
+    detail::state_writer(data) << header.magic << header.state_bytes << header.count << header.reserved;
+    std::byte* out = data + sizeof(EngineFileHeader);
+    for (E const& engine : engines) {
+      engine.save(std::span<std::byte>(out, record));
+      out += record;
+    }
+    ok = munmap(memory, bytes) == 0;
+    ok = fdatasync(fd) == 0 and ok;
+  }
+  ok = (close(fd) == 0) and ok;
+  if (not ok or std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    std::cerr << "save_engines: could not write " << path << '\n';
+    std::remove(tmp_path.c_str());
+    return false;
   }
+  return true;
+}
+
+/**
+ * restores engines from a file written by save_engines(). The file has to hold
+ * exactly engines.size() states of the same size.
+ * @returns false, leaving engines untouched, if the file is missing or does not match.
+ */
+template<BinaryStateEngine E, std::size_t Extent>
+bool load_engines(std::string const& path, std::span<E, Extent> engines)
+{
+  using detail::EngineFileHeader;
+  std::size_t const record = E::state_bytes();
+  std::size_t const bytes = sizeof(EngineFileHeader) + record*engines.size();
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { std::cerr << "load_engines: cannot open " << path << '\n'; return false; }
+  struct stat st{};
+  void* memory = MAP_FAILED;
+  if (fstat(fd, &st) == 0 and static_cast<std::size_t>(st.st_size) == bytes) {
+    memory = mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  }
+  close(fd);
+  if (memory == MAP_FAILED) { std::cerr << "load_engines: " << path << " does not hold " << engines.size() << " engines\n"; return false; }
+  auto const* data = static_cast<std::byte const*>(memory);
+  EngineFileHeader header{};
+  detail::state_reader(data) >> header.magic >> header.state_bytes >> header.count >> header.reserved;
+  bool const ok = header.magic == EngineFileHeader::magic_value and header.state_bytes == record and
+                  header.count == engines.size();
+  if (ok) {
+    std::byte const* in = data + sizeof(EngineFileHeader);
+    for (E& engine : engines) {
+      engine.load(std::span<std::byte const>(in, record));
+      in += record;
+    }
+  }
+  else {
+    std::cerr << "load_engines: " << path << " does not hold " << engines.size() << " engines of this type\n";
+  }
+  munmap(memory, bytes);
+  return ok;
+}
+#endif
+
+/**
+ * outcome of one of the statistical smoke tests below. They are quick checks that
+ * an optimized engine did not lose quality by accident, not a replacement for
+ * TestU01 or PractRand.
+ */
+struct RngTestResult {
+  std::string_view name;
+  double statistic = 0;
+  double p_value = 0;
 
+  /** a sound engine fails with probability alpha. */
+  [[nodiscard]] bool passed(double alpha=1e-4) const { return p_value >= alpha; }
+
+  friend auto operator<<(std::ostream& os, RngTestResult const& r) -> std::ostream& {
+    os << r.name << ": statistic " << r.statistic << ", p " << r.p_value << (r.passed() ? ", passed" : ", FAILED");
+    return os;
+  }
 };
 
+namespace detail {
+/** upper tail of the chi-square distribution, with the Wilson-Hilferty approximation. */
+inline double chi_square_p_value(double x, double degrees_of_freedom)
+{
+  double const h = 2.0 / (9.0*degrees_of_freedom);
+  double const z = (std::cbrt(x / degrees_of_freedom) - (1.0 - h)) / std::sqrt(h);
+  return 0.5*std::erfc(z / std::sqrt(2.0));
+}
+
+inline double chi_square(std::span<uint64_t const> observed, std::span<double const> expected)
+{
+  double x = 0;
+  for (std::size_t i = 0; i < observed.size(); ++i) {
+    double const d = static_cast<double>(observed[i]) - expected[i];
+    x += d*d / expected[i];
+  }
+  return x;
+}
+}
+
+/**
+ * Marsaglia's birthday spacings test: 512 birthdays in a year of 2^24 days give a
+ * Poisson number of repeated spacings with mean 2. Uses the top 24 of 32 bits, or
+ * with low_bits the lowest 24 bits of the raw output, where linear engines are weakest.
+ */
+template<UniformRandomBitGenerator G>
+RngTestResult birthday_spacings_test(G& g, bool low_bits=false)
+{
+  constexpr std::size_t birthdays = 512;
+  constexpr int repetitions = 200;
+  constexpr double lambda = 2.0; // birthdays^3 / (4 * 2^24)
+  std::vector<uint32_t> days(birthdays);
+  uint64_t repeats = 0;
+  for (int r = 0; r < repetitions; ++r) {
+    for (uint32_t& day : days) {
+      day = low_bits ? static_cast<uint32_t>(g() - G::min()) & 0xFF'FFFFu : detail::draw_word<uint32_t>(g) >> 8;
+    }
+    std::sort(days.begin(), days.end());
+    for (std::size_t i = birthdays - 1; i > 0; --i) { days[i] -= days[i - 1]; }
+    std::sort(days.begin(), days.end());
+    for (std::size_t i = 1; i < birthdays; ++i) { repeats += days[i] == days[i - 1]; }
+  }
+  double const mean = lambda*repetitions;
+  double const z = (static_cast<double>(repeats) - mean) / std::sqrt(mean);
+  return {low_bits ? "birthday spacings, low bits" : "birthday spacings", static_cast<double>(repeats),
+          std::erfc(std::abs(z) / std::sqrt(2.0))};
+}
+
+/**
+ * Knuth's gap test: the gaps between numbers below 1/16 are geometrically
+ * distributed. 50000 gap lengths are binned into 0 to 63 and longer.
+ */
+template<UniformRandomBitGenerator G>
+RngTestResult gap_test(G& g)
+{
+  constexpr std::size_t gaps = 50'000;
+  constexpr std::size_t longest = 64;
+  constexpr double p = 1.0 / 16;
+  std::array<uint64_t, longest + 1> observed{};
+  std::size_t length = 0;
+  for (std::size_t found = 0; found < gaps; ) {
+    if (canonical<double>(g) < p) {
+      ++observed[std::min(length, longest)];
+      ++found;
+      length = 0;
+    }
+    else { ++length; }
+  }
+  std::array<double, longest + 1> expected;
+  double tail = gaps;
+  for (std::size_t r = 0; r < longest; ++r) {
+    expected[r] = tail*p;
+    tail -= expected[r];
+  }
+  expected[longest] = tail;
+  double const x = detail::chi_square(observed, expected);
+  return {"gap", x, detail::chi_square_p_value(x, longest)};
+}
+
+/**
+ * linear complexity test of NIST SP 800-22 on the lowest output bit: 200 blocks of
+ * 1000 bits, whose Berlekamp-Massey complexity should be close to 500. Engines that
+ * are linear over GF(2) with less than 500 bits of state, like the xorshift family
+ * and the low bit of xoshiro256+, fail it by design.
+ */
+template<UniformRandomBitGenerator G>
+RngTestResult linear_complexity_test(G& g)
+{
+  constexpr std::size_t blocks = 200;
+  constexpr std::size_t block_bits = 1000;
+  constexpr std::array<double, 7> probabilities{0.010417, 0.03125, 0.125, 0.5, 0.25, 0.0625, 0.020833};
+  double const mean = block_bits / 2.0 + (9.0 + (block_bits % 2 ? 1.0 : -1.0)) / 36.0;
+  std::vector<uint8_t> bits(block_bits);
+  std::vector<uint8_t> polynomial(block_bits + 1);
+  std::array<uint64_t, 7> observed{};
+  for (std::size_t b = 0; b < blocks; ++b) {
+    for (uint8_t& bit : bits) { bit = static_cast<uint8_t>((g() - G::min()) & 1u); }
+    double const length = detail::berlekamp_massey(bits, polynomial);
+    double const t = (block_bits % 2 ? -1.0 : 1.0)*(length - mean) + 2.0/9.0;
+    std::size_t const category = t <= -2.5 ? 0 : t > 2.5 ? 6 : static_cast<std::size_t>(std::floor(t + 3.5));
+    ++observed[category];
+  }
+  std::array<double, 7> expected;
+  for (std::size_t i = 0; i < expected.size(); ++i) { expected[i] = blocks*probabilities[i]; }
+  double const x = detail::chi_square(observed, expected);
+  return {"linear complexity, low bit", x, detail::chi_square_p_value(x, 6)};
+}
+
+/** all smoke tests, about 0.2 s for a fast engine. */
+template<UniformRandomBitGenerator G>
+std::array<RngTestResult, 4> rng_smoke_test(G& g)
+{
+  return {birthday_spacings_test(g), birthday_spacings_test(g, true), gap_test(g), linear_complexity_test(g)};
+}
 
 }
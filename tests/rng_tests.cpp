@@ -0,0 +1,150 @@
+/*
+ * Tests of the random number engines in code_utils.hpp. They are kept out of the header
+ * so that including it stays cheap. Compile-time checks are static_asserts, the rest runs
+ * in main, which returns the number of failed checks.
+ *
+ *   g++ -std=c++20 -O2 -I code_utils tests/rng_tests.cpp -o rng_tests && ./rng_tests
+ */
+#include "code_utils.hpp"
+
+using namespace cutils;
+
+namespace {
+int failures = 0;
+
+void check(bool ok, char const* what)
+{
+  if (not ok) {
+    std::cerr << "FAILED: " << what << '\n';
+    ++failures;
+  }
+}
+
+// jumping with the power table that discard uses at runtime must agree with stepping one
+// by one. A 16-bit engine keeps the table cheap to build at compile time. Distances too large
+// to step are checked through the period, which uses every table entry, and through
+// jump(z) followed by one step being jump(z + 1).
+static_assert([] {
+  using engine = xorshift_engine<uint16_t, 7, 9, 8>;
+  constexpr unsigned long long period = (1ull << 16) - 1;
+  auto const table = detail::gf2_power_table<uint16_t, 16>(engine::step);
+  uint16_t const start = 42;
+  uint16_t stepped = start;
+  for (unsigned long long z = 0; z <= 1024; ++z) {
+    if ((z < 32 or z%97 == 0 or std::has_single_bit(z)) and engine::jump(table, start, z) != stepped) { return false; }
+    stepped = engine::step(stepped);
+  }
+  if (engine::jump(table, start, period) != start) { return false; }
+  for (unsigned long long z : {period - 1, period - 2, 0x7fffull, 0x8000ull, 0xabcdull, 0xfff0ull}) {
+    if (engine::step(engine::jump(table, start, z)) != engine::jump(table, start, z + 1)) { return false; }
+  }
+  // discard reduces modulo the period and then uses the same jump
+  engine jumped(start);
+  jumped.discard((1ull << 40) + 5);
+  return jumped.state() == engine::jump(table, start, ((1ull << 40) + 5) % period);
+}());
+
+// a table of random numbers computed by the compiler
+constexpr auto compile_time_table = [] {
+  xorshift64star rng;
+  std::array<uint64_t, 16> table{};
+  for (uint64_t& v : table) { v = rng(); }
+  return table;
+}();
+static_assert(compile_time_table[15] != compile_time_table[0]);
+
+// first outputs of the reference implementations for the state {1, 2, 3, 4}
+static_assert(xoshiro256starstar({1, 2, 3, 4})() == 11520);
+static_assert(xoshiro256plus({1, 2, 3, 4})() == 5);
+static_assert(xoshiro128plusplus({1, 2, 3, 4})() == 641);
+
+// known answers from the Random123 test vectors
+static_assert(philox4x32::bijection({0, 0, 0, 0}, {0, 0}) ==
+              philox4x32::block_type{0x6627e8d5u, 0xe169c58du, 0xbc57ac4cu, 0x9b00dbd8u});
+static_assert(philox4x32::bijection({0x243f6a88u, 0x85a308d3u, 0x13198a2eu, 0x03707344u}, {0xa4093822u, 0x299f31d0u}) ==
+              philox4x32::block_type{0xd16cfe09u, 0x94fdccebu, 0x5001e420u, 0x24126ea1u});
+static_assert(threefry2x64::bijection({0, 0}, threefry2x64::key(0, 0)) ==
+              threefry2x64::block_type{0xc2b6e3a8c2c69865ull, 0x6f81ed42f350084dull});
+
+/** discard against a loop of operator(), and large jumps against the same jump in two parts. */
+template<typename E>
+bool discard_matches_stepping()
+{
+  E stepped(42);
+  unsigned long long done = 0;
+  for (unsigned long long z : {1ull, 2ull, 33ull, 1000ull, 65'537ull, 1'000'000ull, 100'000'000ull}) {
+    for (; done < z; ++done) { stepped(); }
+    E jumped(42);
+    jumped.discard(z);
+    if (jumped != stepped) { return false; }
+  }
+  for (unsigned long long z : {1ull << 40, 0xdeadbeefcafef00dull, ~0ull}) {
+    E jumped(42);
+    E in_parts(42);
+    jumped.discard(z);
+    in_parts.discard(z/3);
+    in_parts.discard(z - z/3);
+    if (jumped != in_parts) { return false; }
+  }
+  return true;
+}
+
+void test_constexpr_table()
+{
+  xorshift64star rng;
+  bool same = true;
+  for (uint64_t v : compile_time_table) { same = same and v == rng(); }
+  check(same, "xorshift64star gives the same numbers at compile time and at runtime");
+}
+
+void test_xorshift_discard()
+{
+  check(discard_matches_stepping<xorshift32>(), "xorshift32 discard agrees with stepping");
+  check(discard_matches_stepping<xorshift64>(), "xorshift64 discard agrees with stepping");
+  check(discard_matches_stepping<xorshift64star>(), "xorshift64star discard agrees with stepping");
+  // a full period of xorshift32 returns to the start
+  xorshift32 around(42);
+  around.discard((1ull << 32) - 1);
+  check(around == xorshift32(42), "xorshift32 discard of one period");
+}
+
+void test_low_discrepancy_bounds()
+{
+  sobol s(4);
+  std::array<double, 3> short_point{};
+  std::array<double, 4> point{};
+  check(not s.next(std::span(short_point)) and s.index() == 0, "sobol rejects a point shorter than dimensions()");
+  check(not s.skip_to(sobol::size) and s.index() == 0, "sobol rejects indices from 2^32 on");
+  check(s.skip_to(sobol::size - 1) and s.next(std::span(point)), "sobol gives its last point");
+  check(not s.next(std::span(point)), "sobol stops after 2^32 points");
+  check(not s.discard(1), "sobol cannot discard past its end");
+
+  // skipping near the end agrees with stepping there
+  sobol stepped(4, sobol::size - 3);
+  sobol skipped(4);
+  skipped.skip_to(sobol::size - 3);
+  std::array<uint32_t, 4> a{};
+  std::array<uint32_t, 4> b{};
+  bool same = true;
+  for (int i = 0; i < 3; ++i) {
+    stepped.next_integers(std::span(a));
+    skipped.skip_to(sobol::size - 3 + i);
+    skipped.next_integers(std::span(b));
+    same = same and a == b;
+  }
+  check(same, "sobol skip_to near 2^32 agrees with stepping");
+
+  halton h(3);
+  std::array<double, 2> short_halton{};
+  check(not h.next(std::span(short_halton)) and h.index() == 0, "halton rejects a point shorter than dimensions()");
+}
+}
+
+int main()
+{
+  test_constexpr_table();
+  test_xorshift_discard();
+  test_low_discrepancy_bounds();
+  if (failures == 0) { std::cout << "all rng tests passed\n"; }
+  return failures;
+}